@@ -1,35 +1,72 @@
 # Creates a user group called 'Students'(if already does not exist)
 # Adds Student records to database from 'student_records.csv' and simultaneously adds them to Students group.
+# Existing users (by username) get the email, name and password of their record.
+#
+# Usage: python3 add_student_records.py [csv file] [hashing processes]
+# Password hashes are computed over a pool of processes beforehand and the
+# users written BATCH_SIZE at a time, so thousands of records take seconds
+# rather than one round trip and one hash after the other each.
 
 import os
+import sys
+import csv
 import django
+from multiprocessing import Pool,cpu_count
 
 CSV_FILE_ADDR = 'student_records.csv'
 DELIMITER = ','
+BATCH_SIZE = 500 # users per insert
 
 os.environ['DJANGO_SETTINGS_MODULE']='judge.settings'
 django.setup()
 
 from django.contrib.auth.models import User,Group
-group=Group.objects.get_or_create(name = 'Students')[0]
+from django.contrib.auth.hashers import make_password
+from django.db import transaction
 
-def add_user(user_data,group):
-    username,email,fullname,password = user_data
-    x=fullname.find(' ')
+def read_records(path):
+    """ (username, email, first name, last name, password) of every record """
+    records = []
+    with open(path,'r',newline='') as f:
+        for row in csv.reader(f,delimiter=DELIMITER):
+            if len(row) < 4:
+                continue
+            username,email,fullname,password = [field.strip() for field in row[:4]]
+            first,_,last = fullname.partition(' ')
+            records.append((username,email,first,last,password))
+    # the last record of a username counts
+    return list({r[0]: r for r in records}.values())
 
-    user, created = User.objects.get_or_create(username = username, email = email)
-    if not created:
-        user.set_password(password)
-        user.first_name = fullname[:x]
-        user.last_name = fullname[x+1:]
+def hash_passwords(passwords,processes):
+    """ make_password of every password, spread over processes """
+    with Pool(processes) as pool:
+        return pool.map(make_password,passwords,chunksize=max(1,len(passwords) // (processes * 4)))
 
-    group.user_set.add(user);
-    user.save()
-    group.save()
+def add_users(records,hashes,group):
+    """ Creates or updates the users of records and adds them to group.
+        Returns (created, updated) """
+    existing = {user.username: user for user in User.objects.filter(username__in=[r[0] for r in records])}
+    new_users = []
+    with transaction.atomic():
+        for (username,email,first,last,password),hashed in zip(records,hashes):
+            user = existing.get(username)
+            if user is None:
+                new_users.append(User(username=username,email=email,first_name=first,last_name=last,password=hashed))
+            else:
+                User.objects.filter(id=user.id).update(email=email,first_name=first,last_name=last,password=hashed)
+        User.objects.bulk_create(new_users,batch_size=BATCH_SIZE)
+        # bulk_create does not give back ids on every database
+        ids = User.objects.filter(username__in=[r[0] for r in records]).values_list('id',flat=True)
+        members = set(group.user_set.values_list('id',flat=True))
+        Membership = User.groups.through
+        Membership.objects.bulk_create([Membership(user_id=i,group_id=group.id) for i in ids if i not in members],batch_size=BATCH_SIZE)
+    return len(new_users),len(existing)
 
-student_csv = open(CSV_FILE_ADDR,'r')
-
-record = student_csv.readline()[:-1]
-while(record!=''):
-    add_user(record.split(DELIMITER),group)
-    record = student_csv.readline()[:-1]
+if __name__ == '__main__':
+    path = sys.argv[1] if len(sys.argv) > 1 else CSV_FILE_ADDR
+    processes = int(sys.argv[2]) if len(sys.argv) > 2 else cpu_count()
+    group=Group.objects.get_or_create(name = 'Students')[0]
+    records = read_records(path)
+    hashes = hash_passwords([r[4] for r in records],processes)
+    created,updated = add_users(records,hashes,group)
+    print("{} users created, {} updated".format(created,updated))
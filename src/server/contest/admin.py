@@ -1,6 +1,10 @@
 from django.contrib import admin
-from .models import Problem, Submission
+from .models import Problem, Submission, JudgeNode, JudgeJob, Standing, UserScore
 
 # Register your models here.
 admin.site.register(Problem)
 admin.site.register(Submission)
+admin.site.register(JudgeNode)
+admin.site.register(JudgeJob)
+admin.site.register(Standing)
+admin.site.register(UserScore)
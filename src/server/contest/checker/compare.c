@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h> // memcmp(), memchr()
+#include <errno.h>
+#include <fcntl.h> // open()
+#include <unistd.h> // close()
+#include <sys/mman.h> // mmap(), madvise()
+#include <sys/stat.h> // fstat()
+
+#include "../sandbox/logger.h"
+#include "compare.h"
+
+// Files are compared in blocks of this size so that a mismatch early in a
+// large output only pages in the start of both files
+#define BLOCK_SIZE (64 * 1024)
+
+/*
+  Returns:
+    -1 on error
+    0 on success
+
+  Resource residue (on success):
+    'mf -> data' - mapping, released by 'unmapFile'
+*/
+int mapFile(const char *path, MappedFile *mf) {
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    printErr(__FILE__, __LINE__, "fstat failed", 1, errno);
+    close(fd);
+    return -1;
+  }
+  mf -> len = st.st_size;
+  mf -> data = NULL;
+  // mmap does not accept a length of 0
+  if (mf -> len > 0) {
+    void *data = mmap(NULL, mf -> len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      printErr(__FILE__, __LINE__, "mmap failed", 1, errno);
+      close(fd);
+      return -1;
+    }
+    // both files are read once, front to back
+    madvise(data, mf -> len, MADV_SEQUENTIAL);
+    mf -> data = data;
+  }
+  if (close(fd) == -1) {
+    printErr(__FILE__, __LINE__, "close failed", 1, errno);
+  }
+  return 0;
+}
+
+void unmapFile(MappedFile *mf) {
+
+  if (mf -> data != NULL && munmap((void *)mf -> data, mf -> len) == -1) {
+    printErr(__FILE__, __LINE__, "munmap failed", 1, errno);
+  }
+  mf -> data = NULL;
+}
+
+int compareExact(
+  const MappedFile *expected, const MappedFile *actual, size_t *offset) {
+
+  size_t len = expected -> len < actual -> len ? expected -> len : actual -> len;
+  size_t pos = 0;
+  // memcmp is vectorised by the C library; only a differing block is walked
+  // byte by byte to find the offset
+  while (pos < len) {
+    size_t n = len - pos < BLOCK_SIZE ? len - pos : BLOCK_SIZE;
+    if (memcmp(expected -> data + pos, actual -> data + pos, n) != 0) {
+      while (expected -> data[pos] == actual -> data[pos]) {
+        pos++;
+      }
+      *offset = pos;
+      return CHK_DIFFERENT;
+    }
+    pos += n;
+  }
+  *offset = len;
+  return expected -> len == actual -> len ? CHK_SAME : CHK_DIFFERENT;
+}
+
+/*
+  Length of the line starting at |pos| without its '\n' and trailing
+  whitespace; '*next' is set to the start of the next line.
+*/
+static size_t trimmedLine(const MappedFile *mf, size_t pos, size_t *next) {
+
+  const char *nl = memchr(mf -> data + pos, '\n', mf -> len - pos);
+  size_t end = nl == NULL ? mf -> len : (size_t)(nl - mf -> data);
+  *next = nl == NULL ? mf -> len : end + 1;
+  while (end > pos && (mf -> data[end - 1] == ' ' ||
+    mf -> data[end - 1] == '\t' || mf -> data[end - 1] == '\r')) {
+    end--;
+  }
+  return end - pos;
+}
+
+/*
+  Returns 1 if only whitespace is left from |pos| on, else 0
+*/
+static int onlyBlanks(const MappedFile *mf, size_t pos) {
+
+  while (pos < mf -> len) {
+    char c = mf -> data[pos++];
+    if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int compareTolerant(
+  const MappedFile *expected, const MappedFile *actual, size_t *offset) {
+
+  size_t e = 0, a = 0;
+  while (e < expected -> len && a < actual -> len) {
+    size_t e_next, a_next;
+    size_t e_len = trimmedLine(expected, e, &e_next);
+    size_t a_len = trimmedLine(actual, a, &a_next);
+    size_t n = e_len < a_len ? e_len : a_len;
+    if (memcmp(expected -> data + e, actual -> data + a, n) != 0 ||
+      e_len != a_len) {
+      size_t i = 0;
+      while (i < n && expected -> data[e + i] == actual -> data[a + i]) {
+        i++;
+      }
+      *offset = a + i;
+      return CHK_DIFFERENT;
+    }
+    e = e_next;
+    a = a_next;
+  }
+  *offset = a;
+  return onlyBlanks(expected, e) && onlyBlanks(actual, a) ?
+    CHK_SAME : CHK_DIFFERENT;
+}
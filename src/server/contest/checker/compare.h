@@ -0,0 +1,40 @@
+#ifndef COMPARE_H_
+#define COMPARE_H_
+
+#include <stddef.h>
+
+// Return values of the compare functions and exit codes of 'checker'
+#define CHK_SAME 0
+#define CHK_DIFFERENT 1
+#define CHK_FAILURE 2
+
+/*
+  A file mapped into memory for comparison. 'data' is NULL for an empty file.
+*/
+typedef struct MappedFile {
+  const char *data;
+  size_t len;
+} MappedFile;
+
+int mapFile(const char *path, MappedFile *mf);
+
+void unmapFile(MappedFile *mf);
+
+/*
+  Byte for byte comparison.
+
+  Returns:
+    CHK_SAME or CHK_DIFFERENT; '*offset' is set to the offset in |actual| of
+    the first byte that differs (or at which one of the files ends)
+*/
+int compareExact(
+  const MappedFile *expected, const MappedFile *actual, size_t *offset);
+
+/*
+  Like 'compareExact', but spaces, tabs and '\r' at the end of a line and
+  blank lines at the end of a file are ignored.
+*/
+int compareTolerant(
+  const MappedFile *expected, const MappedFile *actual, size_t *offset);
+
+#endif
@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "compare.h"
+
+/*
+  ./checker [--tolerant] <expected_file> <actual_file>
+
+  Prints "<verdict> <offset>", where verdict is one of CHK_SAME, CHK_DIFFERENT
+  and CHK_FAILURE, and offset the first differing byte of <actual_file> (-1 if
+  the files match). The exit code is the verdict as well.
+*/
+int main(int argc, char *argv[]) {
+
+  int tolerant = argc == 4 && strcmp(argv[1], "--tolerant") == 0;
+  if (argc != 3 + tolerant) {
+    fprintf(stderr, "usage: %s [--tolerant] expected_file actual_file\n",
+      argv[0]);
+    printf("%d -1\n", CHK_FAILURE);
+    return CHK_FAILURE;
+  }
+
+  MappedFile expected, actual;
+  if (mapFile(argv[1 + tolerant], &expected) == -1) {
+    printf("%d -1\n", CHK_FAILURE);
+    return CHK_FAILURE;
+  }
+  if (mapFile(argv[2 + tolerant], &actual) == -1) {
+    unmapFile(&expected);
+    printf("%d -1\n", CHK_FAILURE);
+    return CHK_FAILURE;
+  }
+
+  size_t offset;
+  int verdict = tolerant ?
+    compareTolerant(&expected, &actual, &offset) :
+    compareExact(&expected, &actual, &offset);
+  if (verdict == CHK_SAME) {
+    printf("%d -1\n", verdict);
+  } else {
+    printf("%d %zu\n", verdict, offset);
+  }
+
+  unmapFile(&expected);
+  unmapFile(&actual);
+  return verdict;
+}
@@ -0,0 +1,2 @@
+gcc -O2 *.c ../sandbox/logger.c -o checker
+./checker ../testcases/1/output1 ../sandbox/output
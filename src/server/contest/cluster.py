@@ -0,0 +1,269 @@
+import os
+import json
+import math
+import shutil
+import socket
+import threading
+import time
+from datetime import timedelta
+from django.db import connection
+from django.utils import timezone
+from .sandbox_config import *
+from .models import Submission, JudgeNode, JudgeJob, Problem as contest_problem
+from . import judge_queue
+from . import metrics
+from . import runner
+from . import compile_cache
+from . import standings
+from . import sandbox_client
+from . import testcase_index
+
+# Judging on several hosts. The coordinator (manage.py judge_coordinator)
+# takes pending submissions off the queue and splits their testcases into
+# jobs; each judge node (manage.py judge_node) registers itself, keeps its
+# free slots up to date, runs the jobs it pulls and saves their results,
+# which the coordinator puts together once every job of a submission is done.
+# All of it goes through the database the hosts share, the same way judge
+# workers already take submissions (see judge_queue.claim_next).
+#
+# Nodes copy the testcases of their jobs from CLUSTER_TESTCASES_SOURCE into
+# CLUSTER_CACHE_DIR and keep them. A job goes to a node that holds the
+# testcases of its problem; other nodes only take it once it has waited for
+# CLUSTER_STEAL_AFTER seconds, or if no live node holds them.
+
+# name of the record of the files a node copied, in its local testcase
+# directories: {file name: sha256}
+FETCHED_FILE = 'fetched.json'
+
+def problem_cases(problem):
+    """ Manifest entries of the testcases of the contest Problem problem """
+    return testcase_index.cases(problem,CLUSTER_TESTCASES_SOURCE + '/' + str(problem.problem_id))
+
+def live_nodes():
+    since = timezone.now() - timedelta(seconds=CLUSTER_NODE_TIMEOUT)
+    return JudgeNode.objects.filter(last_seen__gte=since)
+
+# ---- coordinator ----
+
+def split(submission):
+    """ Turns the claimed submission into jobs, about one per live node with a
+        free slot, of at least CLUSTER_MIN_JOB_CASES testcases each """
+    problem = contest_problem.objects.get(problem_id=submission.problem_id)
+    cases = len(problem_cases(problem))
+    with open(submission.source,'rb') as f:
+        source = f.read().decode('latin-1')
+    extension = os.path.splitext(submission.source)[1]
+    nodes = max(1,live_nodes().filter(free_slots__gt=0).count())
+    size = max(CLUSTER_MIN_JOB_CASES,math.ceil(cases / nodes))
+    jobs = [JudgeJob(submission=submission,first=first,last=min(first + size,cases),source=source,extension=extension)
+            for first in range(0,cases,size)]
+    JudgeJob.objects.bulk_create(jobs)
+    return jobs
+
+def cancel_decided(submission,problem):
+    """ With all or nothing scoring, marks the pending jobs of submission not
+        run once one of its jobs failed a testcase """
+    if problem.scoring != contest_problem.ALL_OR_NOTHING:
+        return
+    done = submission.jobs.filter(status=JudgeJob.DONE).values_list('verdicts',flat=True)
+    if not any(v != '0' for verdicts in done for v in verdicts.split(',') if v != ''):
+        return
+    for job in submission.jobs.filter(status=JudgeJob.PENDING):
+        cases = job.last - job.first
+        JudgeJob.objects.filter(id=job.id,status=JudgeJob.PENDING).update(
+            status=JudgeJob.DONE,verdicts=','.join([str(runner.NOT_RUN)] * cases),
+            results=json.dumps([{} for i in range(cases)]),fingerprints=','.join([''] * cases))
+
+def finish(submission):
+    """ Saves the score, verdicts and results of submission from its jobs if
+        all of them are done. Returns True if it did """
+    problem = contest_problem.objects.get(problem_id=submission.problem_id)
+    cancel_decided(submission,problem)
+    jobs = list(submission.jobs.order_by('first'))
+    if any(job.status != JudgeJob.DONE for job in jobs):
+        return False
+    tests,results,fingerprints = [],[],[]
+    for job in jobs:
+        tests += [int(v) for v in job.verdicts.split(',') if v != '']
+        results += json.loads(job.results) if job.results else []
+        # one per testcase of the range, '' where there is none
+        job_fingerprints = job.fingerprints.split(',') if job.fingerprints else []
+        fingerprints += (job_fingerprints + [''] * (job.last - job.first))[:job.last - job.first]
+    weights = [case['weight'] for case in problem_cases(problem)]
+    submission.score = runner.compute_score(tests,problem.max_score,problem.scoring,weights) if tests else 0
+    submission.verdicts = ','.join(str(test) for test in tests)
+    submission.results = json.dumps(results)
+    submission.fingerprints = ','.join(fingerprints)
+    submission.status = Submission.DONE
+    submission.save(update_fields=['score','verdicts','results','fingerprints','status'])
+    standings.record(submission)
+    if submission.priority == Submission.LIVE:
+        metrics.observe("crux_judge_seconds",judge_queue.since_upload(submission))
+    submission.jobs.all().delete()
+    # the source is kept for rejudges, as by judge_queue.judge
+    return True
+
+def requeue_dead():
+    """ Hands the running jobs of nodes that stopped sending heartbeats back to
+        the pending ones. Returns how many """
+    since = timezone.now() - timedelta(seconds=CLUSTER_NODE_TIMEOUT)
+    return JudgeJob.objects.filter(status=JudgeJob.RUNNING,node__last_seen__lt=since).update(status=JudgeJob.PENDING,node=None)
+
+def run_coordinator(once=False):
+    """ Splits pending submissions and finishes judged ones until stopped, or
+        until nothing is pending or running if once """
+    while True:
+        requeue_dead()
+        submission = judge_queue.claim_next()
+        while submission is not None:
+            try:
+                if not split(submission):
+                    # no testcases
+                    finish(submission)
+            except OSError as e:
+                # missing testcases or source; as judge_queue.run_worker
+                print(e)
+                Submission.objects.filter(id=submission.id).update(status=Submission.DONE)
+            submission = judge_queue.claim_next()
+        running = Submission.objects.filter(status=Submission.RUNNING,jobs__isnull=False).distinct()
+        finished = [s for s in running if finish(s)]
+        metrics.flush()
+        if once and not finished and not running.exists():
+            return
+        time.sleep(judge_queue.POLL_INTERVAL)
+
+# ---- node ----
+
+class Node():
+    """ One judge host; runs one job at a time on all of its SANDBOX_SLOTS """
+
+    def __init__(self,name=None):
+        self.name = name or CLUSTER_NODE_NAME or socket.gethostname()
+        self.testcases_dir = CLUSTER_CACHE_DIR + '/testcases'
+        self.sources_dir = CLUSTER_CACHE_DIR + '/sources'
+        os.makedirs(self.testcases_dir,exist_ok=True)
+        os.makedirs(self.sources_dir,exist_ok=True)
+        self.node,created = JudgeNode.objects.get_or_create(name=self.name)
+        self.busy = False
+        self.heartbeat()
+
+    def held_problems(self):
+        return sorted(int(p) for p in os.listdir(self.testcases_dir) if p.isdigit())
+
+    def heartbeat(self):
+        """ Registers the node as alive, with its free slots and testcases """
+        free = 0 if self.busy else SANDBOX_SLOTS
+        JudgeNode.objects.filter(id=self.node.id).update(
+            slots=SANDBOX_SLOTS,free_slots=free,last_seen=timezone.now(),
+            problems=','.join(str(p) for p in self.held_problems()))
+
+    def beat(self,stop):
+        """ Heartbeats while a job runs, which may take longer than
+            CLUSTER_NODE_TIMEOUT """
+        while not stop.wait(CLUSTER_HEARTBEAT):
+            self.heartbeat()
+        connection.close()
+
+    def claim(self):
+        """ Marks the first job this node may take running and returns it, or
+            None. See the top of this file for which jobs those are """
+        held = set(self.held_problems())
+        others = set()
+        for node in live_nodes().exclude(id=self.node.id):
+            others.update(node.problem_ids)
+        stale = timezone.now() - timedelta(seconds=CLUSTER_STEAL_AFTER)
+        # jobs of uploads before those of rejudges
+        pending = JudgeJob.objects.filter(status=JudgeJob.PENDING).select_related('submission').order_by('submission__priority','id')
+        for job in pending[:CLUSTER_CLAIM_WINDOW]:
+            problem = job.submission.problem_id
+            if problem in held or problem not in others or job.created <= stale:
+                claimed = JudgeJob.objects.filter(id=job.id,status=JudgeJob.PENDING).update(status=JudgeJob.RUNNING,node=self.node)
+                if claimed:
+                    return job
+        return None
+
+    def fetch(self,problem_id,cases):
+        """ Copies the testcases cases (manifest entries) of problem_id that
+            are missing or changed locally, going by the hashes of the
+            manifest. Returns the local testcase directory """
+        source = CLUSTER_TESTCASES_SOURCE + '/' + str(problem_id)
+        local = self.testcases_dir + '/' + str(problem_id)
+        os.makedirs(local,exist_ok=True)
+        try:
+            with open(local + '/' + FETCHED_FILE) as f:
+                fetched = json.load(f)
+        except (OSError,ValueError):
+            fetched = {}
+        copied = False
+        for case in cases:
+            for name,digest in ((case['input'],case['input_sha256']),(case['output'],case['output_sha256'])):
+                if fetched.get(name) != digest:
+                    shutil.copy(source + '/' + name,local + '/' + name)
+                    fetched[name] = digest
+                    copied = True
+        if copied:
+            with open(local + '/' + FETCHED_FILE,'w') as f:
+                json.dump(fetched,f)
+        return local
+
+    def run(self,job):
+        """ Judges the testcases of job and saves its verdicts and results """
+        submission = job.submission
+        problem = contest_problem.objects.get(problem_id=submission.problem_id)
+        cases = problem_cases(problem)[job.first:job.last]
+        testcase_dir = self.fetch(submission.problem_id,cases)
+        source_file = self.sources_dir + '/' + str(job.id) + job.extension
+        with open(source_file,'wb') as f:
+            f.write(job.source.encode('latin-1'))
+        try:
+            evaluate = runner.Runner(submission,testcase_dir=testcase_dir,cases=cases,source_file=source_file,first=job.first)
+            evaluate.check_all()
+            verdicts,results,fingerprints = evaluate.tests,evaluate.results,evaluate.fingerprints
+        finally:
+            os.remove(source_file)
+        JudgeJob.objects.filter(id=job.id).update(
+            status=JudgeJob.DONE,verdicts=','.join(str(test) for test in verdicts),
+            results=json.dumps(results),fingerprints=','.join(fingerprints))
+
+    def serve(self,once=False):
+        """ Runs jobs until stopped, or until none is left if once """
+        while True:
+            job = self.claim()
+            if job is None:
+                if once:
+                    return
+                time.sleep(judge_queue.POLL_INTERVAL)
+                self.heartbeat()
+                continue
+            self.busy = True
+            self.heartbeat()
+            stop = threading.Event()
+            beat = threading.Thread(target=self.beat,args=(stop,),daemon=True)
+            beat.start()
+            retry = False
+            try:
+                self.run(job)
+            except compile_cache.CompileFailure as e:
+                # as judge_queue.run_worker: the range goes back to the queue,
+                # for this or another node
+                print(e)
+                JudgeJob.objects.filter(id=job.id,status=JudgeJob.RUNNING).update(status=JudgeJob.PENDING,node=None)
+                retry = True
+            except Exception as e:
+                # as judge_queue.run_worker: retrying would fail the same way,
+                # so the range is done, as failed runs of the sandbox
+                print(e)
+                cases = job.last - job.first
+                JudgeJob.objects.filter(id=job.id).update(
+                    status=JudgeJob.DONE,verdicts=','.join(['1'] * cases),
+                    results=json.dumps([sandbox_client.failed_result() for i in range(cases)]))
+            finally:
+                stop.set()
+                beat.join()
+                self.busy = False
+                self.heartbeat()
+                metrics.flush()
+            if retry:
+                if once:
+                    return
+                time.sleep(judge_queue.POLL_INTERVAL)
@@ -0,0 +1,75 @@
+import os
+import hashlib
+import subprocess
+import tempfile
+from .sandbox_config import *
+from . import compile_worker
+
+_compiler_versions = {}
+
+class CompileFailure(Exception):
+    """ The build did not get to an end of its own (compile server down or
+        timing out, limits exceeded, a failed sandbox), so says nothing about
+        the source; the submission is to be judged again later """
+
+def compiler_version(compiler=COMPILER):
+    """ First line of 'compiler --version', read once per process so that
+        upgrading the compiler does not reuse binaries built by the old one """
+    if compiler not in _compiler_versions:
+        try:
+            process = subprocess.run([compiler,"--version"],stdout=subprocess.PIPE,stderr=subprocess.PIPE)
+            _compiler_versions[compiler] = process.stdout.decode(errors='replace').split('\n')[0]
+        except OSError:
+            _compiler_versions[compiler] = ""
+    return _compiler_versions[compiler]
+
+def cache_key(source,flags,compiler=COMPILER):
+    """ Content address of a build: sha256 of the source bytes, the flags and the
+        compiler and its version """
+    digest = hashlib.sha256()
+    digest.update(source)
+    for part in [compiler,compiler_version(compiler)] + list(flags):
+        digest.update(b'\0' + part.encode())
+    return digest.hexdigest()
+
+def compile(source_path,flags=COMPILE_FLAGS,compiler=COMPILER):
+    """ Returns the path of the cached executable built from source_path, compiling
+        it first if no submission with the same source and flags was built before.
+        Returns None on compilation error or when the compiler exceeded its
+        limits; errors are cached as well, in <key>.err holding the
+        compiler's stderr. Raises CompileFailure when the build failed for
+        another reason """
+    with open(source_path,'rb') as source_file:
+        key = cache_key(source_file.read(),flags,compiler)
+    executable_path = COMPILE_CACHE_DIR + key
+    error_path = executable_path + '.err'
+    if os.path.exists(executable_path):
+        return executable_path
+    if os.path.exists(error_path):
+        return None
+
+    os.makedirs(COMPILE_CACHE_DIR,exist_ok=True)
+    # build under a private name and rename, so that a concurrent compile of
+    # the same source never sees a half written binary
+    fd, temp_path = tempfile.mkstemp(dir=COMPILE_CACHE_DIR,prefix='.build-')
+    os.close(fd)
+    try:
+        status, diagnostics = compile_worker.build(source_path,temp_path,flags,compiler)
+        if status == compile_worker.BUILD_LIMIT:
+            # judged as an error, but not cached: the limits may be raised
+            return None
+        if status == compile_worker.BUILD_ERROR:
+            # an error in the source, the only result that is cached
+            with open(temp_path,'wb') as error_file:
+                error_file.write(diagnostics)
+            os.replace(temp_path,error_path)
+            return None
+        if status != compile_worker.BUILD_OK:
+            raise CompileFailure("build of " + source_path + " failed")
+        # run by the sandbox as UID, not by the owner of the cache
+        os.chmod(temp_path,0o755)
+        os.replace(temp_path,executable_path)
+    finally:
+        if os.path.exists(temp_path):
+            os.remove(temp_path)
+    return executable_path
@@ -0,0 +1,102 @@
+import os
+import shutil
+import socket
+import subprocess
+import tempfile
+import threading
+from concurrent.futures import ThreadPoolExecutor
+from .sandbox_config import *
+from . import sandbox_client
+
+# Return codes of build(), mirroring those of the compiler
+BUILD_OK = 0
+BUILD_ERROR = 1 # the source does not compile
+BUILD_LIMIT = 2 # the compiler exceeded its limits or was killed on this source
+BUILD_FAILURE = -1 # the compile server or the sandbox failed; worth retrying
+
+# exit code of the jail's /compile script when it could not start the
+# compiler (see sandbox/compile.sh); compilers do not exit with it
+COMPILE_SETUP_FAILED = 125
+
+_workers = ThreadPoolExecutor(max_workers=COMPILE_WORKERS)
+# compiles that are running or waiting for a worker
+_queue = threading.BoundedSemaphore(COMPILE_WORKERS + COMPILE_QUEUE_SIZE)
+
+def build_local(source_path,executable_path,flags,compiler):
+    """ Runs compiler in this process' environment, without any limits """
+    try:
+        process = subprocess.run([compiler,source_path,"-o",executable_path] + list(flags),stdout=subprocess.PIPE,stderr=subprocess.PIPE)
+    except OSError as e:
+        # compiler not installed
+        print(e)
+        return BUILD_FAILURE, b''
+    if process.returncode == 0:
+        return BUILD_OK, process.stderr
+    if process.returncode > 0:
+        return BUILD_ERROR, process.stderr
+    return BUILD_LIMIT, process.stderr
+
+def build_sandboxed(source_path,executable_path,flags,compiler):
+    """ Runs compiler in COMPILE_JAIL_DIR through the compile server. The jail's
+        /compile script reads the work directory, source file name, compiler and
+        flags from its stdin, and its stdout (the compiler's diagnostics) goes
+        to a log file """
+    work_root = COMPILE_JAIL_DIR + "work/"
+    work_dir = tempfile.mkdtemp(dir=work_root)
+    try:
+        os.chmod(work_dir,0o777)
+        # the extension tells the compiler the language
+        source_name = "source" + os.path.splitext(source_path)[1]
+        shutil.copy(source_path,work_dir + "/" + source_name)
+        request_file = work_dir + "/request"
+        log_file = work_dir + "/log"
+        with open(request_file,'w') as request:
+            # paths as seen from inside the jail
+            request.write("/work/" + os.path.basename(work_dir) + "\n")
+            request.write(source_name + "\n" + compiler + "\n" + " ".join(flags) + "\n")
+
+        # no profile: the compile server has a whitelist of its own
+        header = ["compile",COMPILE_JAIL_DIR,COMPILE_MEMORY_LIMIT,COMPILE_TIME_LIMIT,COMPILE_MAX_PIDS,COMPILE_OUTPUT_LIMIT,"-",str(COMPILE_WALL_TIME * 10**9)]
+        try:
+            with socket.socket(socket.AF_UNIX,socket.SOCK_STREAM) as sock:
+                # the server ends the compile at COMPILE_WALL_TIME; this only
+                # guards against a server that hangs
+                sock.settimeout(2 * COMPILE_WALL_TIME)
+                sock.connect(COMPILE_SOCKET)
+                response = sock.makefile('r')
+                response.readline() # slot, unused: compiles have their own work dirs
+                result = sandbox_client.send_batch(sock,response,header,[(request_file,log_file)])[0]
+        except OSError as e:
+            # compile server not running or not answering
+            print(e)
+            return BUILD_FAILURE, b''
+
+        diagnostics = b''
+        if os.path.exists(log_file):
+            with open(log_file,'rb') as log:
+                diagnostics = log.read()
+        # verdict 0: the compiler ran to its end within the limits, and
+        # exit_code is its own; the sandbox reports its own failures as
+        # verdict 1 whatever the exit code, the others are the compiler's
+        exit_code = result['exit_code']
+        if result['verdict'] == 0 and exit_code == 0 and os.path.exists(work_dir + "/executable"):
+            shutil.move(work_dir + "/executable",executable_path)
+            return BUILD_OK, diagnostics
+        if result['verdict'] == 0 and exit_code not in (-1,0,COMPILE_SETUP_FAILED):
+            return BUILD_ERROR, diagnostics
+        if result['verdict'] not in (0,1):
+            return BUILD_LIMIT, diagnostics
+        return BUILD_FAILURE, diagnostics
+    finally:
+        shutil.rmtree(work_dir,ignore_errors=True)
+
+def build(source_path,executable_path,flags=COMPILE_FLAGS,compiler=COMPILER):
+    """ Compiles source_path into executable_path on one of COMPILE_WORKERS
+        workers, blocking while COMPILE_QUEUE_SIZE compiles are waiting already.
+        Returns (BUILD_*, compiler diagnostics) """
+    target = build_sandboxed if COMPILE_BACKEND == "sandbox" else build_local
+    _queue.acquire()
+    try:
+        return _workers.submit(target,source_path,executable_path,flags,compiler).result()
+    finally:
+        _queue.release()
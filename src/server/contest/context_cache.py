@@ -0,0 +1,48 @@
+from django.core.cache import cache
+from .sandbox_config import *
+
+# What the problem list and problem pages show of the problems, which only
+# changes when a problem is edited, kept in the cache instead of being read
+# from the database on every page view. models.py drops it whenever a
+# problem is saved or deleted; other web processes see the change once
+# PROBLEMS_CACHE_SECONDS have passed.
+
+PROBLEM_LIST_KEY = 'contest:problem_list'
+PROBLEM_KEY = 'contest:problem:{}'
+# session key of the username of the logged in user
+SESSION_USERNAME = 'contest_username'
+
+def problem_list():
+    """ (contest problem id, problem_id, title) of the contest problems """
+    data = cache.get(PROBLEM_LIST_KEY)
+    if data is None:
+        from .models import Problem as contest_problem
+        data = list(contest_problem.objects.values_list('id','problem_id','problem__title'))
+        cache.set(PROBLEM_LIST_KEY,data,PROBLEMS_CACHE_SECONDS)
+    return data
+
+def problem(problem_id):
+    """ problem_id, title and statement of problem problem_id, as a dict;
+        raises trial.models.Problem.DoesNotExist """
+    key = PROBLEM_KEY.format(problem_id)
+    data = cache.get(key)
+    if data is None:
+        from trial.models import Problem as all_problems
+        data = all_problems.objects.values('problem_id','title','statement').get(problem_id=problem_id)
+        cache.set(key,data,PROBLEMS_CACHE_SECONDS)
+    return data
+
+def clear(problem_id=None):
+    """ Drops the cached problem list, and problem problem_id if given """
+    cache.delete(PROBLEM_LIST_KEY)
+    if problem_id is not None:
+        cache.delete(PROBLEM_KEY.format(problem_id))
+
+def username(request):
+    """ Username of the logged in user, kept in the session once looked up """
+    name = request.session.get(SESSION_USERNAME)
+    if name is None:
+        name = request.user.username
+        if request.user.is_authenticated:
+            request.session[SESSION_USERNAME] = name
+    return name
@@ -0,0 +1,60 @@
+import os
+import shutil
+from .sandbox_config import *
+
+# The directories sandboxed executables are chrooted into. Every jail holds
+# what JAIL_TEMPLATE_DIR holds (nothing, for the static executables of
+# LANGUAGES) plus the executable being judged. 'prepare_jails' mounts a
+# tmpfs over JAILS_DIR and OUTPUTS_DIR and, at every SLOT_JAIL_DIR, an
+# overlay of the read-only template with a writable layer on the tmpfs, so
+# that neither launching nor writing outputs touches the disk; without it
+# they are plain directories. Jails are set up once and reset after every
+# batch, never rebuilt.
+
+def slot_jail(slot):
+    """ The jail of slot slot of the sandbox server """
+    jail_dir = SLOT_JAIL_DIR.format(slot)
+    if not os.path.isdir(jail_dir):
+        populate(jail_dir)
+    return jail_dir
+
+def worker_jail():
+    """ The jail of this process, for SANDBOX_BACKEND "exe", where runs are
+        not given a slot; one per judge worker, so that workers do not
+        overwrite each other's executable """
+    jail_dir = JAILS_DIR + 'worker{}/'.format(os.getpid())
+    if not os.path.isdir(jail_dir):
+        populate(jail_dir)
+    return jail_dir
+
+def populate(jail_dir):
+    """ Makes jail_dir a plain copy of the template """
+    os.makedirs(jail_dir,exist_ok=True)
+    os.chmod(jail_dir,0o755)
+    if os.path.isdir(JAIL_TEMPLATE_DIR):
+        for name in os.listdir(JAIL_TEMPLATE_DIR):
+            source = JAIL_TEMPLATE_DIR + '/' + name
+            if os.path.isdir(source) and not os.path.islink(source):
+                shutil.copytree(source,jail_dir + '/' + name,symlinks=True)
+            else:
+                shutil.copy2(source,jail_dir + '/' + name,follow_symlinks=False)
+
+def install(jail_dir,executable_path):
+    """ Places executable_path in jail_dir as EXECUTABLE_FILE """
+    shutil.copy(executable_path,jail_dir + '/' + EXECUTABLE_FILE)
+
+def reset(jail_dir):
+    """ Takes out of jail_dir whatever is not part of the template, i.e. the
+        executable and anything a batch left behind """
+    template = set(os.listdir(JAIL_TEMPLATE_DIR)) if os.path.isdir(JAIL_TEMPLATE_DIR) else set()
+    for name in os.listdir(jail_dir):
+        if name in template:
+            continue
+        path = jail_dir + '/' + name
+        if os.path.isdir(path) and not os.path.islink(path):
+            shutil.rmtree(path,ignore_errors=True)
+        else:
+            try:
+                os.remove(path)
+            except OSError:
+                pass
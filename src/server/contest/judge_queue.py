@@ -0,0 +1,113 @@
+import os
+import json
+import shutil
+import time
+from django.utils import timezone
+from .models import Submission
+from .sandbox_config import REJUDGE_WORKERS
+from . import runner
+from . import metrics
+from . import compile_cache
+
+QUEUE_DIR = os.getcwd() + '/contest/submissions/queue'
+# seconds a worker sleeps when no submission is pending
+POLL_INTERVAL = 1
+
+def enqueue(submission,file_path):
+    """ Keeps a copy of file_path for submission and marks it pending. The copy
+        is needed since a later upload of the same user and problem overwrites
+        file_path before this one may have been judged, and for rejudges """
+    os.makedirs(QUEUE_DIR,exist_ok=True)
+    # the extension selects the language, see runner.Runner
+    source = QUEUE_DIR + '/' + str(submission.id) + os.path.splitext(file_path)[1]
+    shutil.copy(file_path,source)
+    submission.source = source
+    submission.status = Submission.PENDING
+    submission.save(update_fields=['source','status'])
+
+def since_upload(submission):
+    """ Seconds since submission was uploaded """
+    return (timezone.now() - submission.time).total_seconds()
+
+def claim_next():
+    """ Returns the oldest pending submission after marking it running, or None.
+        The conditional update lets any number of workers, on any host sharing
+        the database, take submissions without taking one twice. Uploads go
+        before rejudges, and rejudges only while fewer than REJUDGE_WORKERS
+        are running, so that the other workers stay free for uploads """
+    while True:
+        submission = Submission.objects.filter(status=Submission.PENDING).order_by('priority','id').first()
+        if submission is None:
+            return None
+        if submission.priority != Submission.LIVE:
+            running = Submission.objects.filter(status=Submission.RUNNING,priority=submission.priority).count()
+            if running >= REJUDGE_WORKERS:
+                return None
+        claimed = Submission.objects.filter(id=submission.id,status=Submission.PENDING).update(status=Submission.RUNNING)
+        if claimed:
+            submission.status = Submission.RUNNING
+            # a rejudge has waited since its upload long ago
+            if submission.priority == Submission.LIVE:
+                metrics.observe("crux_queue_wait_seconds",since_upload(submission))
+            return submission
+
+def judge(submission):
+    """ Runs all testcases of submission and stores its score and verdicts """
+    evaluate = runner.Runner(submission)
+    evaluate.check_all()
+    evaluate.score_obtained()
+    submission.verdicts = ','.join(str(test) for test in evaluate.tests)
+    submission.results = json.dumps(evaluate.results)
+    submission.fingerprints = ','.join(evaluate.fingerprints)
+    submission.status = Submission.DONE
+    submission.save(update_fields=['verdicts','results','fingerprints','status'])
+    if submission.priority == Submission.LIVE:
+        metrics.observe("crux_judge_seconds",since_upload(submission))
+    # the source is kept for rejudges
+    return evaluate
+
+def rejudge(problem_ids=None):
+    """ Queues the judged submissions of problem_ids (trial problem ids; all if
+        None) again, behind uploads. Those without a kept source (judged
+        before sources were kept) can not be rejudged. Returns (queued,
+        skipped) """
+    judged = Submission.objects.filter(status=Submission.DONE)
+    if problem_ids is not None:
+        judged = judged.filter(problem_id__in=problem_ids)
+    queued = [s.id for s in judged.only('id','source') if s.source and os.path.exists(s.source)]
+    skipped = judged.count() - len(queued)
+    # PENDING only from DONE, so a submission judged meanwhile is not queued twice
+    changed = Submission.objects.filter(id__in=queued,status=Submission.DONE).update(status=Submission.PENDING,priority=Submission.REJUDGE)
+    return changed,skipped
+
+def requeue_running():
+    """ Hands submissions that were running when their worker died back to the
+        queue. Only safe while no other worker is running """
+    return Submission.objects.filter(status=Submission.RUNNING).update(status=Submission.PENDING)
+
+def run_worker(once=False):
+    """ Judges pending submissions until stopped, or until none is left if once """
+    while True:
+        submission = claim_next()
+        if submission is None:
+            if once:
+                return
+            time.sleep(POLL_INTERVAL)
+            continue
+        try:
+            judge(submission)
+        except compile_cache.CompileFailure as e:
+            # not the submission's fault: back to the queue, unscored
+            print(e)
+            Submission.objects.filter(id=submission.id,status=Submission.RUNNING).update(status=Submission.PENDING)
+            metrics.flush()
+            if once:
+                return
+            time.sleep(POLL_INTERVAL)
+            continue
+        except Exception as e:
+            # e.g. missing testcases; retrying would fail the same way, so the
+            # submission is left done without verdicts rather than running
+            print(e)
+            Submission.objects.filter(id=submission.id).update(status=Submission.DONE)
+        metrics.flush()
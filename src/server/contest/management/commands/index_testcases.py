@@ -0,0 +1,17 @@
+from django.core.management.base import BaseCommand
+from contest import testcase_index
+from contest.models import Problem
+
+class Command(BaseCommand):
+    help = "Rebuilds the testcase manifests (see testcase_index.py), e.g. after copying testcases in by hand"
+
+    def add_arguments(self,parser):
+        parser.add_argument('problem_ids',nargs='*',type=int,help="problems to index; all by default")
+
+    def handle(self,*args,**options):
+        problems = Problem.objects.all()
+        if options['problem_ids']:
+            problems = problems.filter(problem_id__in=options['problem_ids'])
+        for problem in problems:
+            testcase_index.reindex(problem)
+            self.stdout.write("indexed problem {}".format(problem.problem_id))
@@ -0,0 +1,11 @@
+from django.core.management.base import BaseCommand
+from contest import cluster
+
+class Command(BaseCommand):
+    help = "Splits pending submissions into jobs for the judge nodes and puts their results together. Run one, instead of judge_worker"
+
+    def add_arguments(self,parser):
+        parser.add_argument('--once',action='store_true',help="exit once no submission is pending or running")
+
+    def handle(self,*args,**options):
+        cluster.run_coordinator(once=options['once'])
@@ -0,0 +1,12 @@
+from django.core.management.base import BaseCommand
+from contest import cluster
+
+class Command(BaseCommand):
+    help = "Registers this host as a judge node and runs the jobs of the judge coordinator. Run one per judge host"
+
+    def add_arguments(self,parser):
+        parser.add_argument('--name',help="name to register under; CLUSTER_NODE_NAME or the host name by default")
+        parser.add_argument('--once',action='store_true',help="exit once no job is pending")
+
+    def handle(self,*args,**options):
+        cluster.Node(options['name']).serve(once=options['once'])
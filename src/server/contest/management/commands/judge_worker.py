@@ -0,0 +1,15 @@
+from django.core.management.base import BaseCommand
+from contest import judge_queue
+
+class Command(BaseCommand):
+    help = "Judges pending submissions. Run as many as the judge hosts can take, on any host sharing the database"
+
+    def add_arguments(self,parser):
+        parser.add_argument('--once',action='store_true',help="exit once no submission is pending")
+        parser.add_argument('--requeue',action='store_true',help="first hand submissions left running by a dead worker back to the queue; only when no other worker runs")
+
+    def handle(self,*args,**options):
+        if options['requeue']:
+            count = judge_queue.requeue_running()
+            self.stdout.write("requeued {} submissions".format(count))
+        judge_queue.run_worker(once=options['once'])
@@ -0,0 +1,9 @@
+from django.core.management.base import BaseCommand
+from contest import standings
+
+class Command(BaseCommand):
+    help = "Recomputes the standings (see standings.py) from all submissions"
+
+    def handle(self,*args,**options):
+        pairs = standings.rebuild()
+        self.stdout.write("recomputed {} user and problem standings".format(pairs))
@@ -0,0 +1,14 @@
+from django.core.management.base import BaseCommand
+from contest import judge_queue
+
+class Command(BaseCommand):
+    help = "Queues the judged submissions of problems again, behind uploads. Only testcases that changed since (see testcase_index.py) are run again"
+
+    def add_arguments(self,parser):
+        parser.add_argument('problem_ids',nargs='*',type=int,help="problems to rejudge; all by default")
+
+    def handle(self,*args,**options):
+        queued,skipped = judge_queue.rejudge(options['problem_ids'] or None)
+        self.stdout.write("queued {} submissions".format(queued))
+        if skipped:
+            self.stdout.write("skipped {} submissions with no kept source".format(skipped))
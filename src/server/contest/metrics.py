@@ -0,0 +1,169 @@
+import os
+import json
+import time
+import threading
+from .sandbox_config import *
+
+# Metrics of the judge in the Prometheus text format, served by the
+# /contest/metrics/ view. Judge workers are processes of their own, so each
+# process counts in memory and writes what it has so far to METRICS_DIR/<pid>
+# (see flush); the view adds up the files of the host and the state of the
+# queue from the database. Optionally every run also appends a trace record,
+# one JSON object per line, to TRACE_FILE.
+
+# upper bounds of the histogram buckets, in seconds
+BUCKETS = [0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300]
+
+HELP = {
+    "crux_sandbox_phase_seconds": ("histogram", "Time taken by a phase of a sandbox run"),
+    "crux_sandbox_judge_cpu_seconds": ("histogram", "Cpu time the sandbox itself spent on a run, monitor included"),
+    "crux_compile_seconds": ("histogram", "Time taken to compile a submission, compile cache included"),
+    "crux_compare_seconds": ("histogram", "Time taken to compare one output with the expected one"),
+    "crux_queue_wait_seconds": ("histogram", "Time from upload until a worker took the submission"),
+    "crux_judge_seconds": ("histogram", "Time from upload until the verdict"),
+    "crux_verdicts_total": ("counter", "Testcases judged, by return code"),
+    "crux_sandbox_busy_slots": ("gauge", "Sandbox batches running"),
+    "crux_sandbox_slots": ("gauge", "Sandbox slots of the host (SANDBOX_SLOTS)"),
+    "crux_submissions": ("gauge", "Submissions by judging status"),
+    "crux_cluster_jobs": ("gauge", "Jobs of the judge cluster by status"),
+    "crux_cluster_free_slots": ("gauge", "Free sandbox slots of the live judge nodes"),
+}
+
+_lock = threading.Lock()
+# name -> {labels (sorted tuple of pairs) -> value}; a histogram's value is
+# [counts per bucket..., count of all, sum]
+_values = {}
+
+def _labels_key(labels):
+    return tuple(sorted((k,str(v)) for k,v in labels.items()))
+
+def observe(name,seconds,**labels):
+    """ Adds seconds to the histogram name """
+    with _lock:
+        series = _values.setdefault(name,{})
+        counts = series.setdefault(_labels_key(labels),[0] * (len(BUCKETS) + 2))
+        for i,bound in enumerate(BUCKETS):
+            if seconds <= bound:
+                counts[i] += 1
+        counts[-2] += 1
+        counts[-1] += seconds
+
+def inc(name,value=1,**labels):
+    """ Adds value to the counter or gauge name """
+    with _lock:
+        series = _values.setdefault(name,{})
+        key = _labels_key(labels)
+        series[key] = series.get(key,0) + value
+
+def flush():
+    """ Writes the values of this process for the metrics view. Judge workers
+        call it after every submission; gauges call it as they change """
+    if not METRICS_DIR:
+        return
+    with _lock:
+        snapshot = {name: [[list(key),value] for key,value in series.items()] for name,series in _values.items()}
+    os.makedirs(METRICS_DIR,exist_ok=True)
+    path = METRICS_DIR + '/' + str(os.getpid())
+    with open(path + '.tmp','w') as f:
+        json.dump(snapshot,f)
+    os.replace(path + '.tmp',path)
+
+class busy_slot():
+    """ Counts a sandbox batch in crux_sandbox_busy_slots while it runs """
+
+    def __enter__(self):
+        inc("crux_sandbox_busy_slots",1)
+        flush()
+
+    def __exit__(self,*exc):
+        inc("crux_sandbox_busy_slots",-1)
+        flush()
+
+def trace(record):
+    """ Appends the dict record to TRACE_FILE, if set """
+    if not TRACE_FILE:
+        return
+    line = json.dumps(record) + "\n"
+    with _lock:
+        with open(TRACE_FILE,'a') as f:
+            f.write(line)
+
+def observe_run(result,testcase,submission_id):
+    """ Takes the trace of result (a dict of sandbox_client.parse_result) out
+        of it into the phase histograms and the trace records """
+    inc("crux_verdicts_total",verdict=result.get('verdict',-1))
+    t = result.pop('trace',None)
+    if t is None or t['release'] == -1:
+        return
+    phases = [("clone",0,t['clone']),("ready",t['clone'],t['ready']),
+              ("limits",t['ready'],t['limits']),("release",t['limits'],t['release']),
+              ("run",t['release'],t['exit']),("cleanup",t['exit'],t['cleanup'])]
+    for phase,start,end in phases:
+        if start != -1 and end != -1:
+            observe("crux_sandbox_phase_seconds",(end - start) / 1e9,phase=phase)
+    if t['judge_cpu'] != -1:
+        observe("crux_sandbox_judge_cpu_seconds",t['judge_cpu'] / 1e9)
+    trace(dict(t,submission=submission_id,testcase=testcase,time=time.time()))
+
+def _alive(pid):
+    try:
+        os.kill(pid,0)
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        pass
+    return True
+
+def _collect():
+    """ The values of every process of the host, added up. Gauges of
+        processes that are gone are left out """
+    total = {}
+    names = os.listdir(METRICS_DIR) if METRICS_DIR and os.path.isdir(METRICS_DIR) else []
+    for name in names:
+        if not name.isdigit():
+            continue
+        try:
+            with open(METRICS_DIR + '/' + name) as f:
+                snapshot = json.load(f)
+        except (OSError,ValueError):
+            continue
+        alive = _alive(int(name))
+        for metric,series in snapshot.items():
+            if HELP.get(metric,("",))[0] == "gauge" and not alive:
+                continue
+            merged = total.setdefault(metric,{})
+            for key,value in series:
+                key = tuple(tuple(pair) for pair in key)
+                if isinstance(value,list):
+                    old = merged.get(key,[0] * len(value))
+                    merged[key] = [a + b for a,b in zip(old,value)]
+                else:
+                    merged[key] = merged.get(key,0) + value
+    return total
+
+def _format_labels(key,extra=()):
+    pairs = list(key) + list(extra)
+    if not pairs:
+        return ""
+    return "{" + ",".join('{}="{}"'.format(k,v.replace('\\','\\\\').replace('"','\\"')) for k,v in pairs) + "}"
+
+def render(gauges):
+    """ All metrics in the Prometheus text format. gauges holds the values
+        read at scrape time: {name: {labels key: value}} """
+    values = _collect()
+    values.update(gauges)
+    lines = []
+    for name in sorted(values):
+        kind,text = HELP.get(name,("untyped",""))
+        lines.append("# HELP {} {}".format(name,text))
+        lines.append("# TYPE {} {}".format(name,kind))
+        for key,value in sorted(values[name].items()):
+            if kind == "histogram":
+                for bound,count in zip(BUCKETS,value):
+                    lines.append("{}_bucket{} {}".format(name,_format_labels(key,[("le",str(bound))]),count))
+                lines.append("{}_bucket{} {}".format(name,_format_labels(key,[("le","+Inf")]),value[-2]))
+                lines.append("{}_count{} {}".format(name,_format_labels(key),value[-2]))
+                lines.append("{}_sum{} {}".format(name,_format_labels(key),value[-1]))
+            else:
+                lines.append("{}{} {}".format(name,_format_labels(key),value))
+    return "\n".join(lines) + "\n"
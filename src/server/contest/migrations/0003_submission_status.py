@@ -0,0 +1,36 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals
+
+from django.db import migrations, models
+
+
+def mark_judged(apps, schema_editor):
+    # submissions made before the queue existed were judged on upload
+    Submission = apps.get_model('contest', 'Submission')
+    Submission.objects.update(status='done')
+
+
+class Migration(migrations.Migration):
+
+    dependencies = [
+        ('contest', '0002_submission'),
+    ]
+
+    operations = [
+        migrations.AddField(
+            model_name='submission',
+            name='status',
+            field=models.CharField(choices=[('pending', 'Pending'), ('running', 'Running'), ('done', 'Done')], db_index=True, default='pending', max_length=10),
+        ),
+        migrations.AddField(
+            model_name='submission',
+            name='source',
+            field=models.CharField(blank=True, max_length=255, null=True),
+        ),
+        migrations.AddField(
+            model_name='submission',
+            name='verdicts',
+            field=models.TextField(blank=True, default=''),
+        ),
+        migrations.RunPython(mark_judged, migrations.RunPython.noop),
+    ]
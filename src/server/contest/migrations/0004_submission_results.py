@@ -0,0 +1,19 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals
+
+from django.db import migrations, models
+
+
+class Migration(migrations.Migration):
+
+    dependencies = [
+        ('contest', '0003_submission_status'),
+    ]
+
+    operations = [
+        migrations.AddField(
+            model_name='submission',
+            name='results',
+            field=models.TextField(blank=True, default=''),
+        ),
+    ]
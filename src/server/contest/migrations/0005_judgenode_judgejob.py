@@ -0,0 +1,43 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals
+
+from django.db import migrations, models
+import django.db.models.deletion
+import django.utils.timezone
+
+
+class Migration(migrations.Migration):
+
+    dependencies = [
+        ('contest', '0004_submission_results'),
+    ]
+
+    operations = [
+        migrations.CreateModel(
+            name='JudgeNode',
+            fields=[
+                ('id', models.AutoField(auto_created=True, primary_key=True, serialize=False, verbose_name='ID')),
+                ('name', models.CharField(max_length=100, unique=True)),
+                ('slots', models.IntegerField(default=0)),
+                ('free_slots', models.IntegerField(default=0)),
+                ('problems', models.TextField(blank=True, default='')),
+                ('last_seen', models.DateTimeField(db_index=True, default=django.utils.timezone.now)),
+            ],
+        ),
+        migrations.CreateModel(
+            name='JudgeJob',
+            fields=[
+                ('id', models.AutoField(auto_created=True, primary_key=True, serialize=False, verbose_name='ID')),
+                ('first', models.IntegerField()),
+                ('last', models.IntegerField()),
+                ('source', models.TextField()),
+                ('extension', models.CharField(default='', max_length=10)),
+                ('status', models.CharField(choices=[('pending', 'Pending'), ('running', 'Running'), ('done', 'Done')], db_index=True, default='pending', max_length=10)),
+                ('created', models.DateTimeField(auto_now_add=True)),
+                ('verdicts', models.TextField(blank=True, default='')),
+                ('results', models.TextField(blank=True, default='')),
+                ('node', models.ForeignKey(blank=True, null=True, on_delete=django.db.models.deletion.SET_NULL, to='contest.JudgeNode')),
+                ('submission', models.ForeignKey(on_delete=django.db.models.deletion.CASCADE, related_name='jobs', to='contest.Submission')),
+            ],
+        ),
+    ]
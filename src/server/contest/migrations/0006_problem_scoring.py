@@ -0,0 +1,19 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals
+
+from django.db import migrations, models
+
+
+class Migration(migrations.Migration):
+
+    dependencies = [
+        ('contest', '0005_judgenode_judgejob'),
+    ]
+
+    operations = [
+        migrations.AddField(
+            model_name='problem',
+            name='scoring',
+            field=models.CharField(choices=[('partial', 'Partial'), ('all', 'All or nothing')], default='partial', max_length=10),
+        ),
+    ]
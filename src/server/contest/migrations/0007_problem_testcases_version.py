@@ -0,0 +1,19 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals
+
+from django.db import migrations, models
+
+
+class Migration(migrations.Migration):
+
+    dependencies = [
+        ('contest', '0006_problem_scoring'),
+    ]
+
+    operations = [
+        migrations.AddField(
+            model_name='problem',
+            name='testcases_version',
+            field=models.IntegerField(default=0),
+        ),
+    ]
@@ -0,0 +1,39 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals
+
+from django.db import migrations, models
+
+
+class Migration(migrations.Migration):
+
+    dependencies = [
+        ('contest', '0007_problem_testcases_version'),
+    ]
+
+    operations = [
+        migrations.AddField(
+            model_name='problem',
+            name='memory_limit',
+            field=models.BigIntegerField(blank=True, help_text='bytes', null=True),
+        ),
+        migrations.AddField(
+            model_name='problem',
+            name='time_limit',
+            field=models.BigIntegerField(blank=True, help_text='cpu time, nanoseconds', null=True),
+        ),
+        migrations.AddField(
+            model_name='problem',
+            name='max_pids',
+            field=models.IntegerField(blank=True, null=True),
+        ),
+        migrations.AddField(
+            model_name='problem',
+            name='output_limit',
+            field=models.BigIntegerField(blank=True, help_text='bytes', null=True),
+        ),
+        migrations.AddField(
+            model_name='problem',
+            name='wall_time_limit',
+            field=models.BigIntegerField(blank=True, help_text='nanoseconds', null=True),
+        ),
+    ]
@@ -0,0 +1,64 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals
+
+from django.conf import settings
+from django.db import migrations, models
+import django.db.models.deletion
+import django.utils.timezone
+
+
+def fill_standings(apps, schema_editor):
+    """ Standings of the submissions made so far, as standings.record """
+    Submission = apps.get_model('contest', 'Submission')
+    Standing = apps.get_model('contest', 'Standing')
+    UserScore = apps.get_model('contest', 'UserScore')
+    for user_id, problem_id in Submission.objects.values_list('user_id', 'problem_id').distinct():
+        submissions = Submission.objects.filter(user_id=user_id, problem_id=problem_id)
+        best = submissions.order_by('-score', 'time').values('score', 'time').first()
+        Standing.objects.create(user_id=user_id, problem_id=problem_id, best_score=best['score'],
+                                best_time=best['time'] if best['score'] > 0 else None,
+                                submissions=submissions.count())
+    for user_id in Standing.objects.values_list('user_id', flat=True).distinct():
+        totals = Standing.objects.filter(user_id=user_id).aggregate(total=models.Sum('best_score'), reached=models.Max('best_time'))
+        UserScore.objects.create(user_id=user_id, total=totals['total'] or 0, reached=totals['reached'])
+
+
+class Migration(migrations.Migration):
+
+    dependencies = [
+        migrations.swappable_dependency(settings.AUTH_USER_MODEL),
+        ('trial', '0003_auto_20170728_2227'),
+        ('contest', '0008_problem_limits'),
+    ]
+
+    operations = [
+        migrations.CreateModel(
+            name='Standing',
+            fields=[
+                ('id', models.AutoField(auto_created=True, primary_key=True, serialize=False, verbose_name='ID')),
+                ('best_score', models.DecimalField(decimal_places=2, default=0, max_digits=5)),
+                ('best_time', models.DateTimeField(blank=True, null=True)),
+                ('submissions', models.IntegerField(default=0)),
+                ('problem', models.ForeignKey(on_delete=django.db.models.deletion.CASCADE, to='trial.Problem')),
+                ('user', models.ForeignKey(on_delete=django.db.models.deletion.CASCADE, to=settings.AUTH_USER_MODEL)),
+            ],
+        ),
+        migrations.CreateModel(
+            name='UserScore',
+            fields=[
+                ('id', models.AutoField(auto_created=True, primary_key=True, serialize=False, verbose_name='ID')),
+                ('total', models.DecimalField(decimal_places=2, default=0, max_digits=8)),
+                ('reached', models.DateTimeField(blank=True, null=True)),
+                ('updated', models.DateTimeField(db_index=True, default=django.utils.timezone.now)),
+                ('user', models.OneToOneField(on_delete=django.db.models.deletion.CASCADE, related_name='contest_score', to=settings.AUTH_USER_MODEL)),
+            ],
+            options={
+                'ordering': ['-total', 'reached', 'user_id'],
+            },
+        ),
+        migrations.AlterUniqueTogether(
+            name='standing',
+            unique_together=set([('user', 'problem')]),
+        ),
+        migrations.RunPython(fill_standings, migrations.RunPython.noop),
+    ]
@@ -1,8 +1,11 @@
+import json
 from django.db import models
 from django.utils.encoding import python_2_unicode_compatible
 from django.contrib.auth.models import User
 from datetime import datetime
 from django.utils import timezone
+from django.db.models.signals import post_save,post_delete
+from django.dispatch import receiver
 # Create your models here.
 
 @python_2_unicode_compatible
@@ -10,6 +13,21 @@ from django.utils import timezone
 class Problem(models.Model):
     problem = models.ForeignKey('trial.problem',verbose_name='problem')
     max_score = models.FloatField(default=0)
+    # "partial": max_score times the fraction of testcases passed. "all": all
+    # of max_score or nothing, so judging stops at the first failed testcase
+    PARTIAL = 'partial'
+    ALL_OR_NOTHING = 'all'
+    SCORING_CHOICES = ((PARTIAL,'Partial'),(ALL_OR_NOTHING,'All or nothing'))
+    scoring = models.CharField(max_length=10,choices=SCORING_CHOICES,default=PARTIAL)
+    # bumped whenever the testcase manifest is rebuilt, see testcase_index
+    testcases_version = models.IntegerField(default=0)
+    # Sandbox limits of the problem; empty takes those of sandbox_config.
+    # Testcases may override them in the manifest, see Runner.case_limits
+    memory_limit = models.BigIntegerField(null=True,blank=True,help_text="bytes")
+    time_limit = models.BigIntegerField(null=True,blank=True,help_text="cpu time, nanoseconds")
+    max_pids = models.IntegerField(null=True,blank=True)
+    output_limit = models.BigIntegerField(null=True,blank=True,help_text="bytes")
+    wall_time_limit = models.BigIntegerField(null=True,blank=True,help_text="nanoseconds")
     class Meta:
         verbose_name = 'Contest Problem'
         ordering = ['problem_id']
@@ -24,5 +42,124 @@ class Submission(models.Model):
     user = models.ForeignKey(User,verbose_name='submitted-by')
     ip = models.GenericIPAddressField(verbose_name='submitted-by IP',blank=True,null=True)
     local_file = models.CharField(max_length=150,null=True,verbose_name='Original File')
+    # Judging state; judge workers (manage.py judge_worker) take pending ones
+    PENDING = 'pending'
+    RUNNING = 'running'
+    DONE = 'done'
+    STATUS_CHOICES = ((PENDING,'Pending'),(RUNNING,'Running'),(DONE,'Done'))
+    status = models.CharField(max_length=10,choices=STATUS_CHOICES,default=PENDING,db_index=True)
+    # copy of the uploaded file, kept for rejudges, see judge_queue
+    source = models.CharField(max_length=255,null=True,blank=True)
+    # comma separated return codes of the testcases, see Runner.check_result
+    verdicts = models.TextField(blank=True,default='')
+    # JSON list of what each testcase used (cpu/wall time, peak memory and
+    # tasks, exit code/signal, output bytes), see sandbox_client.RESULT_FIELDS
+    results = models.TextField(blank=True,default='')
+    # comma separated runner.fingerprint of each testcase as it was judged;
+    # a rejudge reuses the verdicts of testcases whose fingerprint is the same
+    fingerprints = models.TextField(blank=True,default='')
+    # pending submissions are judged lowest first; rejudges wait for uploads
+    LIVE = 0
+    REJUDGE = 1
+    priority = models.IntegerField(default=LIVE)
+    class Meta:
+        index_together = (('status','priority'),)
     def __str__(self):
         return "{} - {} - {}".format(self.user.username,self.problem.title,self.time)
+
+    @property
+    def tests(self):
+        """ Return codes of the testcases as a list, once judged """
+        return [int(v) for v in self.verdicts.split(',') if v != '']
+
+    @property
+    def run_results(self):
+        """ Per testcase results as a list of dicts, once judged """
+        return json.loads(self.results) if self.results else []
+
+class JudgeNode(models.Model):
+    """ A judge host of the cluster (manage.py judge_node), see cluster.py """
+    name = models.CharField(max_length=100,unique=True)
+    # sandbox slots of the node, and how many of them are idle
+    slots = models.IntegerField(default=0)
+    free_slots = models.IntegerField(default=0)
+    # comma separated ids of the problems whose testcases the node holds
+    problems = models.TextField(blank=True,default='')
+    # nodes not seen for CLUSTER_NODE_TIMEOUT are taken as dead
+    last_seen = models.DateTimeField(default=timezone.now,db_index=True)
+    def __str__(self):
+        return self.name
+
+    @property
+    def problem_ids(self):
+        return [int(p) for p in self.problems.split(',') if p != '']
+
+class JudgeJob(models.Model):
+    """ Testcases first to last (exclusive, in sorted order of the input files)
+        of a submission, judged by a single node of the cluster """
+    submission = models.ForeignKey(Submission,on_delete=models.CASCADE,related_name='jobs')
+    first = models.IntegerField()
+    last = models.IntegerField()
+    # the source itself: nodes do not see the queue directory of the web host.
+    # Decoded as latin-1, which gives back the exact bytes
+    source = models.TextField()
+    extension = models.CharField(max_length=10,default='')
+    PENDING = 'pending'
+    RUNNING = 'running'
+    DONE = 'done'
+    STATUS_CHOICES = ((PENDING,'Pending'),(RUNNING,'Running'),(DONE,'Done'))
+    status = models.CharField(max_length=10,choices=STATUS_CHOICES,default=PENDING,db_index=True)
+    node = models.ForeignKey(JudgeNode,on_delete=models.SET_NULL,null=True,blank=True)
+    created = models.DateTimeField(auto_now_add=True)
+    # as Submission.verdicts, results and fingerprints, for the range only
+    verdicts = models.TextField(blank=True,default='')
+    results = models.TextField(blank=True,default='')
+    fingerprints = models.TextField(blank=True,default='')
+    def __str__(self):
+        return "{} [{}, {})".format(self.submission_id,self.first,self.last)
+
+class Standing(models.Model):
+    """ Best score of a user on a problem, kept up to date by standings.record
+        as submissions are scored """
+    user = models.ForeignKey(User,on_delete=models.CASCADE)
+    problem = models.ForeignKey('trial.problem',on_delete=models.CASCADE)
+    best_score = models.DecimalField(default=0,max_digits=5,decimal_places=2)
+    # time of the first submission that scored best_score; None while it is 0
+    best_time = models.DateTimeField(null=True,blank=True)
+    submissions = models.IntegerField(default=0)
+    class Meta:
+        unique_together = (('user','problem'),)
+    def __str__(self):
+        return "{} - {} - {}".format(self.user_id,self.problem_id,self.best_score)
+
+class UserScore(models.Model):
+    """ The ranking: total of the best scores of a user, one row per user that
+        submitted, see standings.py """
+    user = models.OneToOneField(User,on_delete=models.CASCADE,related_name='contest_score')
+    total = models.DecimalField(default=0,max_digits=8,decimal_places=2)
+    # latest best_time of the user's standings; earlier ranks higher on a tie
+    reached = models.DateTimeField(null=True,blank=True)
+    # last change, which invalidates the cached standings pages
+    updated = models.DateTimeField(default=timezone.now,db_index=True)
+    class Meta:
+        ordering = ['-total','reached','user_id']
+    def __str__(self):
+        return "{} - {}".format(self.user_id,self.total)
+
+@receiver(post_save,sender=Problem)
+@receiver(post_save,sender='trial.Problem')
+def reindex_testcases(sender,instance,**kwargs):
+    """ Rebuilds the testcase manifest of an edited problem """
+    from . import testcase_index
+    problems = [instance] if sender is Problem else Problem.objects.filter(problem=instance)
+    for problem in problems:
+        testcase_index.reindex(problem)
+
+@receiver(post_save,sender=Problem)
+@receiver(post_delete,sender=Problem)
+@receiver(post_save,sender='trial.Problem')
+@receiver(post_delete,sender='trial.Problem')
+def clear_problem_cache(sender,instance,**kwargs):
+    """ Drops what the problem pages cached of an edited problem """
+    from . import context_cache
+    context_cache.clear(instance.problem_id)
@@ -0,0 +1,69 @@
+import os
+import subprocess
+from .sandbox_config import *
+
+# verdicts of checker/checker, see checker/compare.h
+CHK_SAME = 0
+CHK_DIFFERENT = 1
+CHK_FAILURE = 2
+
+BLOCK_SIZE = 64 * 1024
+# what checker/compare.c counts as a blank line; bytes.strip() would also drop \f and \v
+BLANKS = b' \t\r\n'
+
+def compare_files(expected_file,actual_file,mode=CHECKER_MODE):
+    """ Compares the two files without reading either into memory as a whole.
+        Returns (verdict, offset of the first differing byte of actual_file or -1).
+        Outputs below CHECKER_MIN_BYTES are compared here: for them the fork and
+        exec of the checker costs more than the comparison itself """
+    if os.path.getsize(expected_file) >= CHECKER_MIN_BYTES and os.access(CHECKER,os.X_OK):
+        return compare_native(expected_file,actual_file,mode)
+    if mode == "tolerant":
+        return compare_tolerant(expected_file,actual_file)
+    return compare_exact(expected_file,actual_file)
+
+def compare_native(expected_file,actual_file,mode=CHECKER_MODE):
+    """ Runs checker/checker on the two files, same result as compare_files """
+    cmd = [CHECKER] + (["--tolerant"] if mode == "tolerant" else []) + [expected_file,actual_file]
+    process = subprocess.run(cmd,stdout=subprocess.PIPE,stderr=subprocess.PIPE)
+    fields = process.stdout.split()
+    if len(fields) == 2:
+        return int(fields[0]), int(fields[1])
+    return CHK_FAILURE, -1
+
+def compare_exact(expected_file,actual_file):
+    offset = 0
+    with open(expected_file,'rb') as expected, open(actual_file,'rb') as actual:
+        while True:
+            e = expected.read(BLOCK_SIZE)
+            a = actual.read(BLOCK_SIZE)
+            if e != a:
+                i = 0
+                while i < len(e) and i < len(a) and e[i] == a[i]:
+                    i += 1
+                return CHK_DIFFERENT, offset + i
+            if not e:
+                return CHK_SAME, -1
+            offset += len(e)
+
+def compare_tolerant(expected_file,actual_file):
+    offset = 0
+    with open(expected_file,'rb') as expected, open(actual_file,'rb') as actual:
+        for a_line in actual:
+            e_line = expected.readline()
+            if not e_line:
+                # only blank lines may be left in actual_file
+                if a_line.strip(BLANKS) or any(line.strip(BLANKS) for line in actual):
+                    return CHK_DIFFERENT, offset
+                return CHK_SAME, -1
+            e_trimmed = e_line.rstrip(b'\n').rstrip(b' \t\r')
+            a_trimmed = a_line.rstrip(b'\n').rstrip(b' \t\r')
+            if e_trimmed != a_trimmed:
+                i = 0
+                while i < len(e_trimmed) and i < len(a_trimmed) and e_trimmed[i] == a_trimmed[i]:
+                    i += 1
+                return CHK_DIFFERENT, offset + i
+            offset += len(a_line)
+        if any(line.strip(BLANKS) for line in expected):
+            return CHK_DIFFERENT, offset
+    return CHK_SAME, -1
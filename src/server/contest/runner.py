@@ -1,8 +1,116 @@
 import os
-import fnmatch
+import json
+import time
+import hashlib
+import shutil
 import subprocess
+import tempfile
 from .sandbox_config import *
-from .models import Problem as contest_problem
+from . import sandbox_client
+from . import sandbox_native
+from . import compile_cache
+from . import output_checker
+from . import testcase_index
+from . import metrics
+from . import standings
+from . import jails
+from .models import Problem as contest_problem, Submission
+
+# return code of the testcases skipped once the score was decided
+NOT_RUN = 8
+# case_order learns from this many of the latest judged submissions of a
+# problem and does so again at most every ORDER_CACHE_SECONDS
+ORDER_HISTORY = 200
+ORDER_CACHE_SECONDS = 60
+# problem id -> (time.monotonic() of computing, {testcase index: (failure
+# rate, mean wall time of the failed runs)})
+_case_stats = {}
+# profile name -> its default limits, see profile_limits
+_profile_limits = {}
+
+def compute_score(tests,max_score,scoring=contest_problem.PARTIAL,weights=None):
+    """ Score of a submission whose testcases returned tests: max_score times
+        the fraction of correct answers (each counting its weight, see
+        testcase_index), or with all or nothing scoring either max_score or 0 """
+    if scoring == contest_problem.ALL_OR_NOTHING:
+        return max_score if all(test == 0 for test in tests) else 0
+    if weights is None or len(weights) != len(tests) or sum(weights) <= 0:
+        weights = [1] * len(tests)
+    passed = sum(weight for test,weight in zip(tests,weights) if test == 0)
+    return passed/sum(weights) * max_score
+
+def worker_output():
+    """ Output file of the runs of SANDBOX_BACKEND "exe" in this process """
+    os.makedirs(OUTPUTS_DIR,exist_ok=True)
+    return OUTPUTS_DIR + 'worker{}'.format(os.getpid())
+
+def profile_limits(profile):
+    """ Default limits of the sandbox profile named profile (keys of
+        sandbox_client.LIMIT_FIELDS, "-" or None for those it does not set),
+        asked once per process from the _sandbox extension or sandbox-exe.
+        None if neither can tell """
+    if profile not in _profile_limits:
+        try:
+            if SANDBOX_BACKEND == "native":
+                defaults = sandbox_native._module().profile_limits(profile)
+            else:
+                process = subprocess.run([EXE,"--limits",profile],stdout=subprocess.PIPE,stderr=subprocess.PIPE,check=True)
+                defaults = dict(zip(sandbox_client.LIMIT_FIELDS,process.stdout.decode().split()))
+        except (OSError,ImportError,ValueError,subprocess.CalledProcessError) as e:
+            # not cached, the sandbox may be built meanwhile
+            print(e)
+            return None
+        _profile_limits[profile] = defaults
+    return _profile_limits[profile]
+
+def fingerprint(case,limits,profile):
+    """ What the verdict of testcase case (a manifest entry) depends on besides
+        the submission: its files, the sandbox profile and its limits, with
+        those given as "-" resolved to the profile's defaults so that changing
+        these shows. "" (never kept) if the defaults are unknown """
+    defaults = profile_limits(profile)
+    if defaults is None:
+        return ""
+    resolved = {f: defaults.get(f) if value in (None,"-") else value for f,value in limits.items()}
+    key = json.dumps([case['input'],case['input_sha256'],case['output_sha256'],profile,sorted(resolved.items())])
+    return hashlib.sha256(key.encode()).hexdigest()[:32]
+
+def case_stats(problem_id):
+    """ How often, and how fast, each testcase of problem_id failed in past
+        submissions; see _case_stats """
+    now = time.monotonic()
+    cached = _case_stats.get(problem_id)
+    if cached is not None and now - cached[0] < ORDER_CACHE_SECONDS:
+        return cached[1]
+    runs,fails,fail_time = {},{},{}
+    latest = Submission.objects.filter(problem_id=problem_id,status=Submission.DONE).order_by('-id').values_list('verdicts','results')[:ORDER_HISTORY]
+    for verdicts,results in latest:
+        tests = [int(v) for v in verdicts.split(',') if v != '']
+        if all(test == 1 for test in tests):
+            # compilation error; says nothing about the testcases
+            continue
+        usage = json.loads(results) if results else []
+        for i,test in enumerate(tests):
+            if test == NOT_RUN:
+                continue
+            runs[i] = runs.get(i,0) + 1
+            if test != 0:
+                fails[i] = fails.get(i,0) + 1
+                wall = usage[i].get('wall_time',-1) if i < len(usage) else -1
+                fail_time[i] = fail_time.get(i,0) + max(wall,0)
+    stats = {i: (fails.get(i,0)/runs[i],fail_time.get(i,0)/fails[i] if i in fails else 0) for i in runs}
+    _case_stats[problem_id] = (now,stats)
+    return stats
+
+def case_order(problem_id,first,cases):
+    """ Indices 0..cases-1 of the testcases first..first+cases-1 of problem_id
+        (in sorted order of the input files): those past submissions failed
+        most often first and, among those, the ones that failed fastest """
+    stats = case_stats(problem_id)
+    def key(i):
+        rate,wall = stats.get(first + i,(0,0))
+        return (-rate,wall,i)
+    return sorted(range(cases),key=key)
 
 class Runner():
     """To compile, execute and evaluate the
@@ -11,136 +119,253 @@ class Runner():
     BASE_TEST_CASES_DIR = os.getcwd() + '/contest/testcases'
     BASE_SUBMISSION_DIR = os.getcwd() + '/contest/submissions'
 
-    def __init__(self,submission):
-        # Takes problem and user object as arguments
+    def __init__(self,submission,testcase_dir=None,cases=None,source_file=None,first=0):
+        # Takes problem and user object as arguments. A judge node (see
+        # cluster.py) passes its local copy of the testcases, the manifest
+        # entries of its range, the index of the first of them and its own
+        # copy of the source
         self.submission = submission
         self.problem_id = self.submission.problem.problem_id
         self.user = self.submission.user.username
-        self.testcase_dir = self.BASE_TEST_CASES_DIR + "/" + str(self.problem_id)
-        self.inputs(self.testcase_dir)
-        self.submission_file = self.BASE_SUBMISSION_DIR + '/' + self.user + '_' + str(self.problem_id) + '.c'
-        self.MAX_SCORE = contest_problem.objects.get(problem_id=self.problem_id).max_score
+        self.testcase_dir = testcase_dir or self.BASE_TEST_CASES_DIR + "/" + str(self.problem_id)
+        problem = contest_problem.objects.get(problem_id=self.problem_id)
+        if cases is None:
+            cases = testcase_index.cases(problem,self.testcase_dir)
+        self.inputs(cases)
+        if source_file is not None:
+            self.submission_file = source_file
+        elif self.submission.source:
+            # queued copy, see judge_queue.enqueue
+            self.submission_file = self.submission.source
+        else:
+            self.submission_file = self.BASE_SUBMISSION_DIR + '/' + self.user + '_' + str(self.problem_id) + DEFAULT_LANGUAGE
+        extension = os.path.splitext(self.submission_file)[1]
+        self.language = LANGUAGES.get(extension,LANGUAGES[DEFAULT_LANGUAGE])
+        self.first = first
+        self.MAX_SCORE = problem.max_score
+        self.scoring = problem.scoring
+        # limits of the problem's testcases, before their own, see case_limits
+        self.limits = sandbox_client.default_limits()
+        problem_limits = {"mem": problem.memory_limit, "cpu_time": problem.time_limit, "num_tasks": problem.max_pids,
+                          "output": problem.output_limit, "wall_time": problem.wall_time_limit}
+        self.limits.update((f,value) for f,value in problem_limits.items() if value is not None)
+        # fingerprint -> (return code, result) of the testcases of an earlier
+        # judging of the submission (a rejudge) worth keeping: those that ran
+        # and did not fail in the sandbox itself
+        self.previous = {}
+        previous = self.submission.fingerprints.split(',') if self.submission.fingerprints else []
+        tests,results = self.submission.tests,self.submission.run_results
+        for key,test,result in zip(previous,tests,results):
+            if key and test not in (1,NOT_RUN):
+                self.previous[key] = (test,result)
 
-    def inputs(self,testcase_dir):
-        """ Prepare input files """
-        self.input_files = fnmatch.filter(os.listdir(testcase_dir),'input*')
-        self.input_files.sort()
+    def inputs(self,cases):
+        """ Prepare input files from manifest entries, see testcase_index """
+        self.cases = cases
+        self.input_files = [case['input'] for case in cases]
 
     def check_all(self):
     # traverses thru all input cases and saves return code for all cases in tests[]
     # Return code : 0=successful;correct answer
     #               5=wrong answer
     #               else error
+    # compile_cache.CompileFailure goes to the caller, nothing is scored then
         self.tests=[]
-        for case in self.input_files:
-            path = self.testcase_dir + '/' + case
-            self.check_result(path)
+        # what each case used, see sandbox_client.RESULT_FIELDS; {} if not run
+        self.results=[]
+        self.fingerprints=[fingerprint(case,self.case_limits(i),self.language['profile']) for i,case in enumerate(self.cases)]
+        # compiled once per submission, not once per input case
+        start = time.time()
+        self.executable_path = compile_cache.compile(self.submission_file,self.language['flags'],self.language['compiler'])
+        metrics.observe("crux_compile_seconds",time.time() - start)
+        if self.executable_path is None:
+            self.tests += [1] * len(self.input_files)
+            self.results += [{} for case in self.input_files]
+        else:
+            if SANDBOX_BACKEND not in ("server","native"):
+                jails.install(jails.worker_jail(),self.executable_path)
+            tests = [NOT_RUN] * len(self.input_files)
+            results = [{} for case in self.input_files]
+            todo = []
+            for i,key in enumerate(self.fingerprints):
+                if key in self.previous:
+                    tests[i],results[i] = self.previous[key]
+                else:
+                    todo.append(i)
+            if self.scoring == contest_problem.ALL_OR_NOTHING and any(test not in (0,NOT_RUN) for test in tests):
+                # a kept verdict decided the score already
+                todo = []
+            for chunk in self.rounds(todo):
+                for i,(test,result) in zip(chunk,self.run_cases(chunk)):
+                    tests[i] = test
+                    results[i] = result
+                if self.scoring == contest_problem.ALL_OR_NOTHING and any(tests[i] != 0 for i in chunk):
+                    # the score is 0 whatever the rest return
+                    break
+            self.tests += tests
+            self.results += results
+            if SANDBOX_BACKEND not in ("server","native"):
+                jails.reset(jails.worker_jail())
 
         # for testing
         print("\n\nTEST CASES RESPONSES : ",end='')
         print(self.tests)
 
-    def check_result(self,input_file):
+    def rounds(self,indices):
+        """ indices of self.input_files, in lists that are run one after the
+            other. Partial scoring runs all of them at once. All or nothing
+            runs them in case_order, SANDBOX_SLOTS testcases first and twice
+            as many every round after, which stops judging soon after a
+            failure without a round trip to the sandbox per testcase """
+        if not indices:
+            return []
+        if self.scoring != contest_problem.ALL_OR_NOTHING:
+            return [list(indices)]
+        wanted = set(indices)
+        order = [i for i in case_order(self.problem_id,self.first,len(self.input_files)) if i in wanted]
+        chunks,size = [],max(1,SANDBOX_SLOTS)
+        while order:
+            chunks.append(order[:size])
+            order = order[size:]
+            size *= 2
+        return chunks
+
+    def run_cases(self,indices):
+        """ Runs the testcases at indices of self.input_files. Returns a
+            (return code, result) pair for each """
+        if SANDBOX_BACKEND in ("server","native"):
+            return self.check_batch(indices)
+        return [self.check_result(i) for i in indices]
+
+    def check_result(self,index):
         """
-            self.tests[] stores return codes of all cases
+            Returns the return code of testcase index and what its run used
             0 : correct answer
             1 : compilation error
             2 : runtime error
             3 : memory limit exceeded
             4 : time limit exceeded
             5 : incorrect answer
+            6 : output limit exceeded
+            7 : wall time limit exceeded
+            8 : not run, the score was decided by the testcases before
         """
-        result = self.execute(self.submission_file,input_file)
+        result = self.safe_execution(self.testcase_dir + '/' + self.input_files[index],self.case_limits(index))
         try:
-            output = result['output']
-            output_file_path = self.testcase_dir + '/' + 'output' + input_file.split('input')[1]
-            output_file = open(output_file_path,'r')
-            expected_output = output_file.read()
-            if output == expected_output :
-                # correct answer
-                self.tests.append(0)
-            else:
-                # incorrect answer
-                self.tests.append(5)
-
+            return self.compare(index,result['output_file'],result['usage'].get('output_bytes',-1)),result['usage']
         except KeyError:
             # compilation/runtime error
-            self.tests.append(result['error'])
-
-    def execute(self,file_path,input_file_path):
-        """ runs files on local computer. file_path is the name of the file with absolute path """
-
-        #file_path cotains the name of the file with path and extension
-        file_path_without_extension = os.path.splitext(file_path)[0]
-        # contains directory part of file_path
-        file_dir = os.path.dirname(file_path)
-        # name of the file
-        file_name = os.path.basename(file_path)
-        # name of the file without extension
-        file_name_without_extension = file_name.split('.')[0]
-        #executable is stored in /sandbox/jail/executable
-        executable_path = os.getcwd() + "/contest/sandbox/jail/executable"
-
-        #printing for testing purposes
-        # print ("file_path: "+file_path)
-        # print ("file_path_without_extension: "+file_path_without_extension)
-        # print ("file dir : "+file_dir)
-        # print ("file name : "+file_name)
-        # print ("file name without extension : "+file_name_without_extension)
-        # print("executable file directory:" + executable_path)
+            return result['error'],result['usage']
+
+    def case_limits(self,index):
+        """ Sandbox limits of testcase index: those of its manifest entry
+            (keys of sandbox_client.LIMIT_FIELDS), then those of the problem,
+            then those of sandbox_config """
+        limits = dict(self.limits)
+        own = self.cases[index].get('limits',{})
+        limits.update((f,own[f]) for f in sandbox_client.LIMIT_FIELDS if own.get(f) is not None)
+        return limits
 
+    def check_batch(self,indices):
+        """ Runs the input files at indices through the sandbox server, or the
+            _sandbox extension, spread over SANDBOX_SLOTS. Testcases with the
+            same limits share batches. Returns the same as run_cases """
+        groups = {}
+        for i in indices:
+            key = tuple(sorted(self.case_limits(i).items()))
+            groups.setdefault(key,[]).append(i)
+        # private to this submission: slots are reused as soon as a batch ends
+        os.makedirs(OUTPUTS_DIR,exist_ok=True)
+        output_dir = tempfile.mkdtemp(dir=OUTPUTS_DIR)
+        outcome = {}
         try:
-            # runs the terminal command - compile (gcc path/name.c -o path/name)
-            process_compile = subprocess.run(["gcc",file_path,"-o", executable_path,"--static"],check=True,stdout=subprocess.PIPE,stderr=subprocess.PIPE)
-            # debug statements: 'process_compile' var holds returned process data
-            # print ("\nprocess_compile stdout:",process_compile.stdout)
-            # print ("process_compile stderr:",process_compile.stderr)
-
-        #if compilation is not clear, then handle it
-        except subprocess.CalledProcessError as e:
-            result = {}
-            # print ("\nCompilation Error\n")
-            # print(e)
-            result['error']=1
-            return result
-            # exit(1)
-
-        #if compilation is clear, try to run the file
-        else:
-            #check if an input file exists. take input from it if exists
-            try:
-                input_file=open(input_file_path)
-            except FileNotFoundError:
-                input_file=subprocess.PIPE
+            for key,group in groups.items():
+                input_files = [self.testcase_dir + '/' + self.input_files[i] for i in group]
+                # judged as each run ends: only the outputs of the runs still
+                # being compared take room on the outputs tmpfs
+                def finished(j,result,output_file,group=group):
+                    outcome[group[j]] = self.judge_run(group[j],result,output_file)
+                try:
+                    backend = sandbox_native if SANDBOX_BACKEND == "native" else sandbox_client
+                    backend.run_parallel(self.executable_path,input_files,output_dir,self.language['profile'],dict(key),finished)
+                except (OSError,ImportError) as e:
+                    # sandbox server is not running or the connection broke, or
+                    # the extension is not built
+                    print(e)
+                for index in group:
+                    if index not in outcome:
+                        outcome[index] = self.judge_run(index,sandbox_client.failed_result(),None)
+        finally:
+            shutil.rmtree(output_dir,ignore_errors=True)
+        return [outcome[i] for i in indices]
 
-            result = self.safe_execution(input_file_path)
-            return result
+    def judge_run(self,index,result,output_file):
+        """ (return code, result) of the run of testcase index that wrote
+            output_file, which is removed """
+        metrics.observe_run(result,self.input_files[index],self.submission.id)
+        verdict = result['verdict']
+        try:
+            if verdict == 0:
+                verdict = self.compare(index,output_file,result['output_bytes'])
+        finally:
+            if output_file is not None and os.path.exists(output_file):
+                os.remove(output_file)
+        return verdict,result
+
+    def compare(self,index,output_file,output_bytes=-1):
+        """ Returns the return code of output_file against the expected output
+            of testcase index. output_bytes is the size of output_file if the
+            sandbox reported it, else -1 """
+        case = self.cases[index]
+        if CHECKER_MODE == "exact" and output_bytes not in (-1,case['output_size']):
+            # incorrect answer; no need to read either file
+            return 5
+        expected_file = self.testcase_dir + '/' + case['output']
+        start = time.time()
+        verdict,offset = output_checker.compare_files(expected_file,output_file)
+        metrics.observe("crux_compare_seconds",time.time() - start)
+        if verdict == output_checker.CHK_SAME :
+            # correct answer
+            return 0
+        else:
+            if verdict == output_checker.CHK_FAILURE:
+                print("checker failed on",output_file)
+            # incorrect answer
+            return 5
 
     def score_obtained(self):
         """ traverses thru test case responses to calculate total score. score = (total score alloted to the problem) * (fraction of correct answers) """
-        responses = self.tests
-        correct_answer = responses.count(0)
-        score = correct_answer/len(responses) * self.MAX_SCORE
+        score = compute_score(self.tests,self.MAX_SCORE,self.scoring,[case['weight'] for case in self.cases])
         self.submission.score = score
         self.submission.save()
+        standings.record(self.submission)
         print("SCORE : ",end='')
         print(score,end="\n\n")
         return score
 
-    def safe_execution(self,input_file_path):
-        """ Uses sandbox to execute compiled executables of submitted C code """
+    def safe_execution(self,input_file_path,limits=None):
+        """ Uses sandbox to execute compiled executables of submitted code,
+            under limits (see sandbox_client.LIMIT_FIELDS), those of the
+            problem if None """
         INPUT_FILE = input_file_path
         result = {}
+        limits = {f: str(value) for f,value in (limits or self.limits).items()}
 
-        cmd = ["sudo",EXE,MEMORY_LIMIT,TIME_LIMIT,MAX_PIDS,MEMORY_CGROUP,CPUACCT_CGROUP,PIDS_CGROUP,JAIL_DIR,EXECUTABLE_FILE,INPUT_FILE,OUTPUT_FILE,WHITELIST,UID,GID]
-        # process = subprocess.run(cmd,check=True,stdout=subprocess.PIPE,stderr=subprocess.PIPE)
+        # jail and output of this worker: workers run at the same time
+        jail_dir,output_file = jails.worker_jail(),worker_output()
+        cmd = ["sudo",EXE,limits["mem"],limits["cpu_time"],limits["num_tasks"],MEMORY_CGROUP,CPUACCT_CGROUP,PIDS_CGROUP,jail_dir,EXECUTABLE_FILE,INPUT_FILE,output_file,WHITELIST,UID,GID,limits["output"],self.language['profile'],limits["wall_time"]]
+        process = subprocess.run(cmd,stdout=subprocess.PIPE)
+        # the last line sandbox-exe prints is its result record
+        lines = process.stdout.decode(errors='replace').strip().split('\n')
         try:
-            subprocess.check_call(cmd,stdout=subprocess.PIPE)
-            output_file = os.getcwd() + '/contest/sandbox/output'
-            output = open(output_file,'r')
-            result['output'] = output.read()
-        except subprocess.CalledProcessError as e:
-            # 2 - runtime error, 3 - memory limit exceeded, 4 - time limit exceeded
-            result['error'] = e.returncode
+            result['usage'] = sandbox_client.parse_result(lines[-1])
+        except ValueError:
+            result['usage'] = {}
+        if process.returncode == 0:
+            result['output_file'] = output_file
+        else:
+            # 2 - runtime error, 3 - memory limit exceeded, 4 - time limit exceeded,
+            # 6 - output limit exceeded, 7 - wall time limit exceeded
+            result['error'] = process.returncode
 
         return result
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h> // malloc(), qsort(), atoi()
+#include <string.h>
+#include <unistd.h> // dup()
+#include <time.h> // clock_gettime()
+#include <sys/resource.h> // getrusage()
+
+#include "../sandbox.h"
+
+/*
+  Runs synthetic workloads through 'sandboxExec' and reports what the
+  sandbox costs: runs per second, launch-to-exit latency of 'sandboxExec',
+  how far past the cpu time limit the kill lands and the cpu time the
+  judge's own process (monitor thread included) spends per run.
+
+  sudo ./bench <memory_cg> <cpuacct_cg> <pids_cg> <uid> <gid> [runs] [workload]
+
+  Expects to be run from its own directory after 'run.sh' built the
+  workloads into './jail'.
+*/
+
+#define BENCH_JAIL "./jail"
+#define BENCH_WHITELIST "./wl_bench"
+#define BENCH_INPUT "./input"
+#define BENCH_OUTPUT "./output"
+#define BENCH_DEFAULT_RUNS 100
+
+typedef struct Workload {
+  const char *name; // also the executable's name in the jail
+  ResLimits lims; // {cpu_time, mem, num_tasks, output, wall_time}
+  int expected; // verdict every run should get
+} Workload;
+
+static const Workload workloads[] = {
+  {"noop", {"1000000000", "64M", "4", "1048576", "2000000000"}, SB_OK},
+  {"spin", {"200000000", "64M", "4", "1048576", "2000000000"}, SB_TIME_EXCEED},
+  {"grow", {"1000000000", "32M", "4", "1048576", "2000000000"}, SB_MEM_EXCEED},
+  {"forkbomb", {"1000000000", "64M", "8", "1048576", "2000000000"},
+    SB_TASK_EXCEED},
+  {"bigout", {"1000000000", "64M", "4", "1048576", "2000000000"},
+    SB_OUTPUT_EXCEED},
+};
+
+static long long nowNs(clockid_t clock) {
+
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long selfCpuNs() {
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000LL +
+    (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000LL;
+}
+
+static int compareLongLong(const void *a, const void *b) {
+
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+  Returns the |p|th percentile of the sorted |values|
+*/
+static long long percentile(const long long *values, int len, int p) {
+
+  int i = (len * p + 99) / 100 - 1;
+  return values[i < 0 ? 0 : i];
+}
+
+static void runWorkload(
+  FILE *report, const Workload *w, int runs, const CgroupLocs *cg_locs,
+  uid_t uid, gid_t gid) {
+
+  long long *latency = malloc(sizeof(long long) * runs);
+  long long *overshoot = malloc(sizeof(long long) * runs);
+  if (latency == NULL || overshoot == NULL) {
+    fprintf(stderr, "malloc failed\n");
+    free(latency);
+    free(overshoot);
+    return;
+  }
+  int i, unexpected = 0, overshoot_len = 0;
+  long long cpu_limit = atoll(w -> lims.cpu_time);
+  long long start = nowNs(CLOCK_MONOTONIC), cpu_start = selfCpuNs();
+  for (i = 0; i < runs; i++) {
+    SandboxResult r;
+    long long t = nowNs(CLOCK_MONOTONIC);
+    sandboxExec(
+      w -> name, BENCH_JAIL, BENCH_INPUT, BENCH_OUTPUT, cg_locs, &(w -> lims),
+      BENCH_WHITELIST, uid, gid, &r);
+    latency[i] = nowNs(CLOCK_MONOTONIC) - t;
+    if (r.verdict != w -> expected) {
+      unexpected++;
+    }
+    if (r.verdict == SB_TIME_EXCEED && r.cpu_time != -1) {
+      overshoot[overshoot_len++] = r.cpu_time - cpu_limit;
+    }
+  }
+  long long elapsed = nowNs(CLOCK_MONOTONIC) - start;
+  long long judge_cpu = selfCpuNs() - cpu_start;
+
+  qsort(latency, runs, sizeof(long long), compareLongLong);
+  fprintf(report, "%-9s %6d %9.1f %9.3f %9.3f %11.3f %6d",
+    w -> name, runs, runs * 1e9 / elapsed,
+    percentile(latency, runs, 50) / 1e6, percentile(latency, runs, 99) / 1e6,
+    judge_cpu / 1e6 / runs, unexpected);
+  if (overshoot_len > 0) {
+    qsort(overshoot, overshoot_len, sizeof(long long), compareLongLong);
+    fprintf(report, " %9.3f %9.3f",
+      percentile(overshoot, overshoot_len, 50) / 1e6,
+      percentile(overshoot, overshoot_len, 99) / 1e6);
+  }
+  fprintf(report, "\n");
+  fflush(report);
+  free(latency);
+  free(overshoot);
+}
+
+int main(int argc, char *argv[]) {
+
+  if (argc < 6) {
+    fprintf(stderr,
+      "usage: %s <memory_cg> <cpuacct_cg> <pids_cg> <uid> <gid> [runs] "
+      "[workload]\n", argv[0]);
+    return 1;
+  }
+  CgroupLocs c;
+  c.memory = argv[1];
+  c.cpuacct = argv[2];
+  c.pids = argv[3];
+  c.cpuset = NULL;
+  c.unified = isUnifiedHierarchy(c.memory) ? c.memory : NULL;
+  // as the sandbox server runs
+  c.pool_size = 1;
+  c.pool_refill = 1;
+  uid_t uid = atoi(argv[4]);
+  gid_t gid = atoi(argv[5]);
+  int runs = argc > 6 ? atoi(argv[6]) : BENCH_DEFAULT_RUNS;
+  const char *only = argc > 7 ? argv[7] : NULL;
+  if (runs < 1) {
+    runs = 1;
+  }
+
+  // the sandbox's own messages would cost time and bury the report
+  FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+  if (report == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+    fprintf(stderr, "redirecting stdout failed\n");
+    return 1;
+  }
+
+  // p50/p99: 'sandboxExec' call to return; judge_cpu: per run, of this
+  // process; wrong: runs without the expected verdict; over: cpu time used
+  // past the limit by runs killed for it
+  fprintf(report, "%-9s %6s %9s %9s %9s %11s %6s %9s %9s\n",
+    "workload", "runs", "runs/s", "p50_ms", "p99_ms", "judge_cpu_ms",
+    "wrong", "over_p50", "over_p99");
+  int i;
+  for (i = 0; i < (int)(sizeof(workloads) / sizeof(workloads[0])); i++) {
+    if (only == NULL || strcmp(only, workloads[i].name) == 0) {
+      runWorkload(report, &(workloads[i]), runs, &c, uid, gid);
+    }
+  }
+  fclose(report);
+  return 0;
+}
@@ -0,0 +1,10 @@
+# Builds the benchmark and its workloads (statically, into ./jail) and runs
+# it. Run from this directory; arguments are passed on to ./bench, e.g.
+#   ./run.sh /sys/fs/cgroup/memory/test /sys/fs/cgroup/cpuacct/test /sys/fs/cgroup/pids/test 1000 1000 200
+mkdir -p jail
+for w in workloads/*.c; do
+  gcc -O2 --static "$w" -o "jail/$(basename "$w" .c)"
+done
+touch input
+make -C .. bench
+sudo ./bench "$@"
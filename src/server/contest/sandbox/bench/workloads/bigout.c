@@ -0,0 +1,15 @@
+#include <string.h>
+#include <unistd.h>
+
+// Writes to stdout until the output limit is hit
+int main() {
+
+  char buf[65536];
+  memset(buf, 'x', sizeof(buf));
+  while (1) {
+    if (write(STDOUT_FILENO, buf, sizeof(buf)) == -1) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,10 @@
+#include <unistd.h>
+
+// Forks until the task limit is hit
+int main() {
+
+  while (1) {
+    fork();
+  }
+  return 0;
+}
@@ -0,0 +1,15 @@
+#include <stdlib.h>
+#include <string.h>
+
+// Touches one more MiB at a time until the memory limit is hit
+int main() {
+
+  while (1) {
+    char *p = malloc(1024 * 1024);
+    if (p == NULL) {
+      return 1;
+    }
+    memset(p, 1, 1024 * 1024);
+  }
+  return 0;
+}
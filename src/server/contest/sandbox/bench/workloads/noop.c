@@ -0,0 +1,5 @@
+// Exits at once; what is left of a run is the cost of the sandbox itself
+int main() {
+
+  return 0;
+}
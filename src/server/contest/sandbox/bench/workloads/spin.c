@@ -0,0 +1,9 @@
+// Burns cpu until the cpu time limit kills it
+int main() {
+
+  volatile unsigned long i = 0;
+  while (1) {
+    i++;
+  }
+  return 0;
+}
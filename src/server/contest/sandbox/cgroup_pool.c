@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h> // malloc(), calloc(), realloc()
+#include <errno.h>
+#include <fcntl.h> // open()
+#include <unistd.h> // close(), write(), rmdir(), access()
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h> // mkdir(), S_IRWXU
+
+#include "logger.h"
+#include "cgroup_pool.h"
+
+// cgroup v2 'cpu.max': the run may use at most one CPU worth of time per
+// period, so its cpu time can never run ahead of wall-clock time
+#define UNIFIED_CPU_MAX "100000 100000"
+
+/*
+  Slots that are configured and not leased. The pool serves only the
+  'CgroupLocs' it was first used with; runs with other locations get
+  directories of their own.
+*/
+typedef struct CgroupPool {
+  pthread_mutex_t lock;
+  const CgroupLocs *cg_locs;
+  CgroupDirs **free_slots; // has room for every slot ever created
+  int free_len;
+  int next_id; // the next slot created is 'pool<next_id>'
+} CgroupPool;
+
+static CgroupPool pool = {PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, 0};
+
+/*
+  Returns a pointer to an NTCS |cg|/|name|.
+
+  Resource residue:
+    1 char malloc
+*/
+static char *joinPath(const char *cg, const char *name) {
+
+  char *path = malloc(sizeof(char) * (strlen(cg) + strlen(name) + 2));
+  sprintf(path, "%s/%s", cg, name);
+  return path;
+}
+
+/*
+  Writes |str| to the file |dir|/|file_name|
+*/
+int writeCgroupFile(const char *dir, const char *file_name, const char *str) {
+
+  char *path = joinPath(dir, file_name);
+  int f = open(path, O_WRONLY | O_CLOEXEC);
+  if (f == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+    free(path);
+    return -1;
+  }
+  if (write(f, str, sizeof(char) * strlen(str)) == -1) {
+    printErr(__FILE__, __LINE__, "write failed", 1, errno);
+    close(f);
+    free(path);
+    return -1;
+  }
+  if (close(f) == -1) {
+    printErr(__FILE__, __LINE__, "close failed", 1, errno);
+    free(path);
+    return -1;
+  }
+  free(path);
+  return 0;
+}
+
+/*
+  Writes |value| to |dir|/|file_name| unless it is what was written there
+  last, which '*last' remembers.
+*/
+int setCgroupLimit(
+  const char *dir, const char *file_name, const char *value, char **last) {
+
+  if (*last != NULL && strcmp(*last, value) == 0) {
+    return 0;
+  }
+  if (writeCgroupFile(dir, file_name, value) == -1) {
+    return -1;
+  }
+  free(*last);
+  *last = strdup(value);
+  return 0;
+}
+
+/*
+  Creates the directory |cg|/|name|.
+
+  Returns:
+    NULL on error
+    a malloc'd NTCS |cg|/|name| on success
+*/
+static char *makeDir(const char *cg, const char *name, int pooled) {
+
+  char *dir = joinPath(cg, name);
+  // TODO: check what permissions are required
+  // a pool slot left behind by an earlier process is simply taken over
+  if (mkdir(dir, S_IRWXU) == -1 && !(pooled && errno == EEXIST)) {
+    printErr(__FILE__, __LINE__, "mkdir failed", 1, errno);
+    free(dir);
+    return NULL;
+  }
+  return dir;
+}
+
+static int removeDirs(const CgroupDirs *d) {
+
+  const char *dirs[] = {d -> memory, d -> cpuacct, d -> pids, d -> unified};
+  int i, ret = 0;
+  for (i = 0; i < 4; i++) {
+    if (dirs[i] != NULL && rmdir(dirs[i]) == -1) {
+      printErr(__FILE__, __LINE__, "rmdir failed", 1, errno);
+      ret = -1;
+    }
+  }
+  return ret;
+}
+
+static void freeDirs(CgroupDirs *d) {
+
+  free(d -> memory);
+  free(d -> cpuacct);
+  free(d -> pids);
+  free(d -> unified);
+  free(d -> mem);
+  free(d -> num_tasks);
+  free(d);
+}
+
+/*
+  Writes the settings that are the same for every run, so that a pool slot
+  carries them from creation on.
+*/
+static int configureDirs(const CgroupDirs *d) {
+
+  if (d -> unified != NULL) {
+    // There is no way to pause under OOM in v2; the kernel kills the
+    // executable and 'memory.oom.group' makes it kill all of its tasks
+    if (writeCgroupFile(d -> unified, "memory.oom.group", "1") == -1 ||
+      writeCgroupFile(d -> unified, "cpu.max", UNIFIED_CPU_MAX) == -1) {
+      return -1;
+    }
+    // 'memory.swap.max' only exists when swap accounting is enabled
+    char *swap_path = joinPath(d -> unified, "memory.swap.max");
+    int has_swap = access(swap_path, F_OK) == 0;
+    free(swap_path);
+    if (has_swap &&
+      writeCgroupFile(d -> unified, "memory.swap.max", "0") == -1) {
+      return -1;
+    }
+    return 0;
+  }
+  // disable swap for the sandboxed executable because mem limits on swap
+  // might not be available on all kernels
+  if (writeCgroupFile(d -> memory, "memory.swappiness", "0") == -1) {
+    return -1;
+  }
+  // disable oom killer, hence the process will be paused when under oom
+  return writeCgroupFile(d -> memory, "memory.oom_control", "1");
+}
+
+/*
+  Creates and configures the directories |name| in the cgroups of |cg_locs|.
+
+  Returns:
+    NULL on error; nothing is left behind
+    not NULL on success
+*/
+static CgroupDirs *createDirs(
+  const CgroupLocs *cg_locs, const char *name, int pooled) {
+
+  CgroupDirs *d = calloc(1, sizeof(CgroupDirs));
+  if (d == NULL) {
+    printErr(__FILE__, __LINE__, "calloc failed", 0, 0);
+    return NULL;
+  }
+  d -> cg_locs = cg_locs;
+  d -> pooled = pooled;
+
+  int ok;
+  if (cg_locs -> unified != NULL) {
+    ok = (d -> unified = makeDir(cg_locs -> unified, name, pooled)) != NULL;
+  } else {
+    ok = (d -> memory = makeDir(cg_locs -> memory, name, pooled)) != NULL &&
+      (d -> cpuacct = makeDir(cg_locs -> cpuacct, name, pooled)) != NULL &&
+      (d -> pids = makeDir(cg_locs -> pids, name, pooled)) != NULL;
+  }
+  if (!ok || configureDirs(d) == -1) {
+    removeDirs(d);
+    freeDirs(d);
+    return NULL;
+  }
+  return d;
+}
+
+/*
+  Adds |n| new slots to the pool. Must be called with 'pool.lock' held.
+*/
+static void growPool(int n) {
+
+  CgroupDirs **slots = realloc(
+    pool.free_slots, sizeof(CgroupDirs *) * (pool.next_id + n));
+  if (slots == NULL) {
+    printErr(__FILE__, __LINE__, "realloc failed", 0, 0);
+    return;
+  }
+  pool.free_slots = slots;
+  int i;
+  for (i = 0; i < n; i++) {
+    char name[24];
+    sprintf(name, "pool%d", pool.next_id++);
+    CgroupDirs *d = createDirs(pool.cg_locs, name, 1);
+    if (d == NULL) {
+      printErr(__FILE__, __LINE__, "createDirs failed", 0, 0);
+      return;
+    }
+    pool.free_slots[pool.free_len++] = d;
+  }
+}
+
+/*
+  Leases a configured slot from the pool when 'cg_locs -> pool_size' > 0 and
+  one is free (or can be added, see 'pool_refill'); otherwise creates the
+  directories |cg|/|pid| for this run only.
+
+  Returns:
+    NULL on error
+    not NULL on success
+
+  Resource residue (when return value != NULL):
+    released by 'releaseCgroupDirs'
+*/
+CgroupDirs *acquireCgroupDirs(const CgroupLocs *cg_locs, pid_t pid) {
+
+  if (cg_locs -> pool_size > 0) {
+    CgroupDirs *d = NULL;
+    pthread_mutex_lock(&pool.lock);
+    if (pool.cg_locs == NULL) {
+      pool.cg_locs = cg_locs;
+      growPool(cg_locs -> pool_size);
+    }
+    if (pool.cg_locs == cg_locs) {
+      if (pool.free_len == 0 && cg_locs -> pool_refill > 0) {
+        growPool(cg_locs -> pool_refill);
+      }
+      if (pool.free_len > 0) {
+        d = pool.free_slots[--pool.free_len];
+      }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    if (d != NULL) {
+      return d;
+    }
+  }
+
+  char name[24];
+  sprintf(name, "%d", pid);
+  return createDirs(cg_locs, name, 0);
+}
+
+/*
+  Returns 1 if no task is left in the slot, else 0
+*/
+static int isEmpty(const CgroupDirs *d) {
+
+  char *path = d -> unified != NULL ?
+    joinPath(d -> unified, "cgroup.events") : joinPath(d -> memory, "tasks");
+  int f = open(path, O_RDONLY | O_CLOEXEC);
+  free(path);
+  if (f == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+    return 0;
+  }
+  char content[128];
+  ssize_t bytes_read = read(f, content, sizeof(content) - 1);
+  close(f);
+  if (bytes_read == -1) {
+    printErr(__FILE__, __LINE__, "read failed", 1, errno);
+    return 0;
+  }
+  content[bytes_read] = '\0';
+  if (d -> unified != NULL) {
+    return strstr(content, "populated 0") != NULL;
+  }
+  return bytes_read == 0;
+}
+
+/*
+  Clears what the previous run left in a slot. Counters that cannot be
+  cleared are handled through the '*_base' fields of 'CgroupDirs'.
+*/
+static int resetDirs(const CgroupDirs *d) {
+
+  if (d -> unified != NULL) {
+    return 0;
+  }
+  if (writeCgroupFile(d -> cpuacct, "cpuacct.usage", "0") == -1 ||
+    // uncharge the page cache (output files etc.) of the previous run
+    writeCgroupFile(d -> memory, "memory.force_empty", "0") == -1 ||
+    writeCgroupFile(d -> memory, "memory.max_usage_in_bytes", "0") == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+/*
+  Returns a leased slot to the pool, or removes the directories of a run
+  that did not use the pool. A slot that still has tasks or cannot be reset
+  is dropped from the pool instead of being handed to the next run.
+*/
+int releaseCgroupDirs(CgroupDirs *d) {
+
+  if (!(d -> pooled)) {
+    int ret = removeDirs(d);
+    freeDirs(d);
+    return ret;
+  }
+  if (!isEmpty(d) || resetDirs(d) == -1) {
+    printErr(__FILE__, __LINE__, "dropping cgroup pool slot", 0, 0);
+    removeDirs(d);
+    freeDirs(d);
+    return -1;
+  }
+  pthread_mutex_lock(&pool.lock);
+  pool.free_slots[pool.free_len++] = d;
+  pthread_mutex_unlock(&pool.lock);
+  return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef CGROUP_POOL_H_
+#define CGROUP_POOL_H_
+
+#include <sys/types.h>
+
+#include "resource_limits.h"
+
+/*
+  The cgroup directories one sandboxed executable runs in. They are either
+  leased from the pool of '|cg|/pool<n>' slots or created as '|cg|/|pid|'
+  for this run only.
+*/
+typedef struct CgroupDirs {
+  char *memory; // v1 only
+  char *cpuacct; // v1 only
+  char *pids; // v1 only
+  char *unified; // v2 only
+  int pooled; // 1 if leased from the pool
+  // Limits last written to the directories; a leased slot is written to
+  // only when the limits differ from those of its previous run
+  char *mem;
+  char *num_tasks;
+  // Counters the kernel does not allow to reset, as read before the run.
+  // The monitor only looks at how far they moved since.
+  long long pids_max_base; // 'max' in 'pids.events'
+  long long oom_kill_base; // v2: 'oom_kill' in 'memory.events'
+  long long usage_base; // v2: 'usage_usec' in 'cpu.stat', in nanoseconds
+  const CgroupLocs *cg_locs;
+} CgroupDirs;
+
+CgroupDirs *acquireCgroupDirs(const CgroupLocs *cg_locs, pid_t pid);
+
+int releaseCgroupDirs(CgroupDirs *dirs);
+
+int writeCgroupFile(const char *dir, const char *file_name, const char *str);
+
+int setCgroupLimit(
+  const char *dir, const char *file_name, const char *value, char **last);
+
+#endif
@@ -0,0 +1,15 @@
+#!/bin/sh
+# Installed as /compile in the compile jail by prepare_compile_jail and run
+# there by the compile server. stdin: the work directory (as seen inside the
+# jail), the name of the source file in it, the compiler and its flags, one
+# per line. The compiler's diagnostics
+# go to stdout, which the sandbox redirects to the log file of the compile.
+# Exits with 125 (compile_worker.COMPILE_SETUP_FAILED) if the compiler can not
+# be started, else with the compiler's exit code.
+read dir
+read source
+read compiler
+read flags
+cd "$dir" || exit 125
+command -v "$compiler" > /dev/null || exit 125
+exec "$compiler" "$source" -o executable $flags 2>&1
@@ -0,0 +1,179 @@
+#define _GNU_SOURCE // for memfd_create(), F_ADD_SEALS; has to be before the
+                    // #includes
+
+#include <stdio.h>
+#include <stdlib.h> // realloc()
+#include <string.h> // strcmp(), strdup()
+#include <errno.h>
+#include <fcntl.h> // open(), fcntl()
+#include <unistd.h> // close()
+#include <sys/types.h>
+#include <sys/stat.h> // stat()
+#include <sys/mman.h> // memfd_create()
+#include <sys/sendfile.h> // sendfile()
+
+#include "logger.h"
+#include "input_cache.h"
+
+#define INPUT_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)
+
+typedef struct CachedInput {
+  char *path;
+  // identity of the file when it was cached; a change of any means the
+  // testcase was replaced and the entry is stale
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  int fd; // sealed memfd
+  unsigned long last_used;
+} CachedInput;
+
+typedef struct InputCache {
+  CachedInput *entries;
+  int len;
+  int cap;
+  long long bytes;
+  long long max_bytes;
+  unsigned long clock; // incremented on every lookup, for LRU eviction
+} InputCache;
+
+static InputCache cache = {NULL, 0, 0, 0, 0, 0};
+
+static void dropEntry(int i) {
+
+  if (close(cache.entries[i].fd) == -1) {
+    printErr(__FILE__, __LINE__, "close failed", 1, errno);
+  }
+  free(cache.entries[i].path);
+  cache.bytes -= cache.entries[i].size;
+  cache.entries[i] = cache.entries[--cache.len];
+}
+
+static void evictFor(long long bytes) {
+
+  while (cache.len > 0 && cache.bytes + bytes > cache.max_bytes) {
+    int lru = 0, i;
+    for (i = 1; i < cache.len; i++) {
+      if (cache.entries[i].last_used < cache.entries[lru].last_used) {
+        lru = i;
+      }
+    }
+    dropEntry(lru);
+  }
+}
+
+/*
+  Copies |path| (|size| bytes) into a new memfd and seals it.
+
+  Returns:
+    -1 on error
+    the memfd on success
+*/
+static int loadInput(const char *path, off_t size) {
+
+  int in = open(path, O_RDONLY | O_CLOEXEC);
+  if (in == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+    return -1;
+  }
+  int fd = memfd_create("sandbox-input", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd == -1) {
+    printErr(__FILE__, __LINE__, "memfd_create failed", 1, errno);
+    close(in);
+    return -1;
+  }
+  off_t copied = 0;
+  while (copied < size) {
+    ssize_t n = sendfile(fd, in, NULL, size - copied);
+    if (n <= 0) {
+      printErr(__FILE__, __LINE__, "sendfile failed", 1, errno);
+      close(in);
+      close(fd);
+      return -1;
+    }
+    copied += n;
+  }
+  close(in);
+  if (fcntl(fd, F_ADD_SEALS, INPUT_SEALS) == -1) {
+    printErr(__FILE__, __LINE__, "fcntl failed", 1, errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void setInputCacheSize(long long max_bytes) {
+
+  cache.max_bytes = max_bytes;
+  evictFor(0);
+}
+
+int getCachedInput(const char *path) {
+
+  if (cache.max_bytes <= 0) {
+    return -1;
+  }
+  struct stat st;
+  if (stat(path, &st) == -1 || !S_ISREG(st.st_mode)) {
+    return -1;
+  }
+  cache.clock++;
+  int i;
+  for (i = 0; i < cache.len; i++) {
+    CachedInput *e = &(cache.entries[i]);
+    if (strcmp(e -> path, path) != 0) {
+      continue;
+    }
+    if (e -> dev == st.st_dev && e -> ino == st.st_ino &&
+      e -> size == st.st_size && e -> mtime.tv_sec == st.st_mtim.tv_sec &&
+      e -> mtime.tv_nsec == st.st_mtim.tv_nsec) {
+      e -> last_used = cache.clock;
+      return e -> fd;
+    }
+    dropEntry(i);
+    break;
+  }
+
+  if (st.st_size > cache.max_bytes) {
+    return -1;
+  }
+  evictFor(st.st_size);
+  if (cache.len == cache.cap) {
+    int cap = cache.cap == 0 ? 16 : cache.cap * 2;
+    CachedInput *entries = realloc(cache.entries, sizeof(CachedInput) * cap);
+    if (entries == NULL) {
+      printErr(__FILE__, __LINE__, "realloc failed", 0, 0);
+      return -1;
+    }
+    cache.entries = entries;
+    cache.cap = cap;
+  }
+  int fd = loadInput(path, st.st_size);
+  if (fd == -1) {
+    return -1;
+  }
+  CachedInput *e = &(cache.entries[cache.len++]);
+  e -> path = strdup(path);
+  e -> dev = st.st_dev;
+  e -> ino = st.st_ino;
+  e -> size = st.st_size;
+  e -> mtime = st.st_mtim;
+  e -> fd = fd;
+  e -> last_used = cache.clock;
+  cache.bytes += st.st_size;
+  return fd;
+}
+
+int openCachedInput(int fd) {
+
+  // a dup would share the file offset with the cache and every other run;
+  // opening the fd through /proc gives an open file description of its own
+  char path[32];
+  sprintf(path, "/proc/self/fd/%d", fd);
+  int in = open(path, O_RDONLY | O_CLOEXEC);
+  if (in == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+  }
+  return in;
+}
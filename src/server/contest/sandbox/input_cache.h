@@ -0,0 +1,38 @@
+#ifndef INPUT_CACHE_H_
+#define INPUT_CACHE_H_
+
+/*
+  Keeps testcase inputs in sealed, read-only memfds so that every run and
+  rejudge of the same input reads it from memory instead of from disk. The
+  cache belongs to the process (one per server worker) and is disabled
+  until 'setInputCacheSize' is called.
+*/
+
+/*
+  Sets the total size in bytes of the inputs kept; least recently used
+  inputs are dropped to stay below it. 0 disables the cache.
+*/
+void setInputCacheSize(long long max_bytes);
+
+/*
+  Returns:
+    -1 if |path| is not cached and cannot be (cache disabled, too large or
+    an error); the caller should open |path| itself
+    otherwise an fd of the cache holding the current content of |path|. It
+    stays owned by the cache and the caller must not close it or depend on
+    its file offset, see 'openCachedInput'.
+*/
+int getCachedInput(const char *path);
+
+/*
+  Opens, for reading, a new file description for the cached fd |fd|, with
+  an offset of its own. The fd is close-on-exec: children cloned by other
+  threads of the process must not keep it across 'execl'.
+
+  Returns:
+    -1 on error
+    the new fd on success
+*/
+int openCachedInput(int fd);
+
+#endif
@@ -1,10 +1,89 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "sandbox.h"
+#include "sandbox_server.h"
+#include "profiles.h"
+
+// cgroup directories the server configures up front and reuses across runs,
+// see 'CgroupLocs'
+#define SERVER_CG_POOL_SIZE 4
+#define SERVER_CG_POOL_REFILL 1
+
+/*
+  Long-lived server mode, see 'sandbox_server.h' for the protocol:
+    sudo ./sandbox-exe --server <socket_path> <memory_cg> <cpuacct_cg>
+      <pids_cg> <whitelist> <uid> <gid> [<slots> [<first_cpu> [<cpuset_cg>]]]
+
+  <slots> sandboxes run in parallel (default 1), slot i pinned to CPU
+  <first_cpu> + i (default 0). Leaving CPU 0 to the web server and keeping
+  <slots> below the number of cores keeps the measured cpu time steady.
+*/
+static int serverMain(int argc, char *argv[]) {
+
+  if (argc < 9 || argc > 12) {
+    fprintf(stderr, "usage: %s --server socket_path memory_cg cpuacct_cg "
+      "pids_cg whitelist uid gid [slots [first_cpu [cpuset_cg]]]\n",
+      argv[0]);
+    return SB_FAILURE;
+  }
+
+  CgroupLocs c;
+
+  const char *socket_path = argv[2];
+  c.memory = argv[3];
+  c.cpuacct = argv[4];
+  c.pids = argv[5];
+  const char *whitelist = argv[6];
+  uid_t uid = atoi(argv[7]);
+  gid_t gid = atoi(argv[8]);
+  int slots = argc > 9 ? atoi(argv[9]) : 1;
+  int first_cpu = argc > 10 ? atoi(argv[10]) : 0;
+  c.cpuset = argc > 11 ? argv[11] : NULL;
+  // on a cgroup2 mount the same directory is expected for all three
+  c.unified = isUnifiedHierarchy(c.memory) ? c.memory : NULL;
+  c.pool_size = SERVER_CG_POOL_SIZE;
+  c.pool_refill = SERVER_CG_POOL_REFILL;
+
+  runSandboxServer(socket_path, &c, whitelist, uid, gid, slots, first_cpu);
+  return SB_FAILURE;
+}
+
+/*
+  Prints the default limits of a language profile, for the judge to tell
+  when they change (see runner.fingerprint):
+    ./sandbox-exe --limits <profile>
+  as one line "<mem> <cpu_time> <num_tasks> <output> <wall_time>", "-" for
+  a limit the profile does not set.
+*/
+static int limitsMain(int argc, char *argv[]) {
+
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s --limits profile\n", argv[0]);
+    return SB_FAILURE;
+  }
+  const SandboxProfile *p = findProfile(argv[2]);
+  if (p == NULL) {
+    fprintf(stderr, "no profile %s\n", argv[2]);
+    return SB_FAILURE;
+  }
+  ResLimits r = {NULL, NULL, NULL, NULL, NULL};
+  applyProfileLimits(p, &r);
+  printf("%s %s %s %s %s\n", r.mem, r.cpu_time, r.num_tasks,
+    r.output != NULL ? r.output : "-", r.wall_time != NULL ? r.wall_time : "-");
+  return SB_OK;
+}
 
 int main(int argc, char *argv[]) {
 
+  if (argc > 1 && strcmp(argv[1], "--server") == 0) {
+    return serverMain(argc, argv);
+  }
+  if (argc > 1 && strcmp(argv[1], "--limits") == 0) {
+    return limitsMain(argc, argv);
+  }
+
   ResLimits r;
   CgroupLocs c;
 
@@ -14,6 +93,11 @@ int main(int argc, char *argv[]) {
   c.memory = argv[4];
   c.cpuacct = argv[5];
   c.pids = argv[6];
+  c.cpuset = NULL;
+  // on a cgroup2 mount the same directory is expected for all three
+  c.unified = isUnifiedHierarchy(c.memory) ? c.memory : NULL;
+  // a single run gains nothing from a pool
+  c.pool_size = c.pool_refill = 0;
   const char *jail_path = argv[7];
   // 'exect_path' must be given relative to 'jail_path'
   const char *exect_path = argv[8];
@@ -23,9 +107,35 @@ int main(int argc, char *argv[]) {
   const char *whitelist = argv[11];
   uid_t uid = atoi(argv[12]);
   gid_t gid = atoi(argv[13]);
+  // optional output limit in bytes
+  r.output = argc > 14 ? argv[14] : NULL;
+  // optional wall time limit in nanoseconds
+  r.wall_time = argc > 16 ? argv[16] : NULL;
+  // optional language profile ("-" for none); 'whitelist' is ignored then
+  // and any limit given as "-" takes the profile's default
+  SandboxResult result;
+  if (argc > 15 && strcmp(argv[15], "-") != 0) {
+    SandboxCase job = {input_file, output_file};
+    if (sandboxExecBatchProfile(
+      exect_path, jail_path, &job, 1, &c, &r,
+      argv[15], uid, gid, &result, NULL, NULL) != SB_OK) {
+      failedSandboxResult(&result);
+    }
+  } else {
+    sandboxExec(
+      exect_path, jail_path,
+      input_file, output_file, &c, &r,
+      whitelist, uid, gid, &result);
+  }
+
+  // the last line of stdout is the result record; the verdict is also the
+  // exit status, as before
+  char line[SB_RESULT_LEN];
+  formatSandboxResult(&result, line, sizeof(line));
+  printf("%s\n", line);
+  return result.verdict;
+}
 
-  return sandboxExec(
-    exect_path, jail_path, 
-    input_file, output_file, &c, &r,
-    whitelist, uid, gid);
-}
\ No newline at end of file
+/*
+  sudo ./a.out "1M" "1000000000" "1" "/sys/fs/cgroup/memory/test" "/sys/fs/cgroup/cpuacct/test" "/sys/fs/cgroup/pids/test" "temp/jail" "exect" "temp/in" "temp/out" "temp/wl" "1000" "1000"
+*/
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <string.h> // strcmp()
+#include <seccomp.h> // SCMP_SYS()
+
+#include "logger.h"
+#include "profiles.h"
+
+#define LEN(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+// Statically linked C; the start-up code of recent glibc needs the second
+// line
+static const int c_syscalls[] = {
+  SCMP_SYS(uname), SCMP_SYS(brk), SCMP_SYS(arch_prctl), SCMP_SYS(readlink),
+  SCMP_SYS(access), SCMP_SYS(fstat), SCMP_SYS(read), SCMP_SYS(lseek),
+  SCMP_SYS(write),
+  SCMP_SYS(set_tid_address), SCMP_SYS(set_robust_list), SCMP_SYS(rseq),
+  SCMP_SYS(prlimit64), SCMP_SYS(readlinkat), SCMP_SYS(getrandom),
+  SCMP_SYS(mprotect), SCMP_SYS(newfstatat), SCMP_SYS(exit),
+};
+
+// Statically linked C++: libstdc++ also maps memory and uses futexes
+static const int cpp_syscalls[] = {
+  SCMP_SYS(uname), SCMP_SYS(brk), SCMP_SYS(arch_prctl), SCMP_SYS(readlink),
+  SCMP_SYS(access), SCMP_SYS(fstat), SCMP_SYS(read), SCMP_SYS(lseek),
+  SCMP_SYS(write),
+  SCMP_SYS(set_tid_address), SCMP_SYS(set_robust_list), SCMP_SYS(rseq),
+  SCMP_SYS(prlimit64), SCMP_SYS(readlinkat), SCMP_SYS(getrandom),
+  SCMP_SYS(mprotect), SCMP_SYS(newfstatat), SCMP_SYS(exit),
+  SCMP_SYS(mmap), SCMP_SYS(munmap), SCMP_SYS(futex), SCMP_SYS(clock_gettime),
+};
+
+// Static Rust (musl): installs a signal stack and handlers for stack
+// overflow detection before 'main'
+static const int rust_syscalls[] = {
+  SCMP_SYS(brk), SCMP_SYS(arch_prctl), SCMP_SYS(read), SCMP_SYS(write),
+  SCMP_SYS(lseek), SCMP_SYS(fstat), SCMP_SYS(set_tid_address),
+  SCMP_SYS(mmap), SCMP_SYS(munmap), SCMP_SYS(mremap), SCMP_SYS(mprotect),
+  SCMP_SYS(rt_sigaction), SCMP_SYS(rt_sigprocmask), SCMP_SYS(sigaltstack),
+  SCMP_SYS(poll), SCMP_SYS(ioctl), SCMP_SYS(futex),
+  SCMP_SYS(sched_getaffinity), SCMP_SYS(exit),
+};
+
+// Static Go: the runtime starts threads and signal handling of its own
+static const int go_syscalls[] = {
+  SCMP_SYS(brk), SCMP_SYS(arch_prctl), SCMP_SYS(read), SCMP_SYS(write),
+  SCMP_SYS(openat), SCMP_SYS(close), SCMP_SYS(fcntl), SCMP_SYS(readlinkat),
+  SCMP_SYS(mmap), SCMP_SYS(munmap), SCMP_SYS(madvise), SCMP_SYS(mincore),
+  SCMP_SYS(rt_sigaction), SCMP_SYS(rt_sigprocmask), SCMP_SYS(rt_sigreturn),
+  SCMP_SYS(sigaltstack), SCMP_SYS(clone), SCMP_SYS(futex),
+  SCMP_SYS(gettid), SCMP_SYS(getpid), SCMP_SYS(tgkill),
+  SCMP_SYS(sched_getaffinity), SCMP_SYS(sched_yield), SCMP_SYS(nanosleep),
+  SCMP_SYS(clock_gettime), SCMP_SYS(epoll_create1), SCMP_SYS(epoll_ctl),
+  SCMP_SYS(epoll_pwait), SCMP_SYS(pipe2), SCMP_SYS(exit),
+};
+
+// {cpu_time, mem, num_tasks, output, wall_time}; threads count against
+// num_tasks. The wall time leaves room for waiting on a busy host, the memory
+// limit room for the usual 256 MB of a contest problem.
+static const SandboxProfile profiles[] = {
+  {"c", c_syscalls, LEN(c_syscalls),
+    {"1000000000", "256M", "4", "16777216", "3000000000"}},
+  {"cpp", cpp_syscalls, LEN(cpp_syscalls),
+    {"1000000000", "256M", "4", "16777216", "3000000000"}},
+  {"rust", rust_syscalls, LEN(rust_syscalls),
+    {"1000000000", "256M", "4", "16777216", "3000000000"}},
+  {"go", go_syscalls, LEN(go_syscalls),
+    {"1000000000", "256M", "16", "16777216", "3000000000"}},
+};
+
+// filters of 'profiles', compiled on first use
+static SysCallList compiled[LEN(profiles)];
+static int is_compiled[LEN(profiles)];
+static pthread_mutex_t compiled_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const SandboxProfile *findProfile(const char *name) {
+
+  int i;
+  for (i = 0; i < LEN(profiles); i++) {
+    if (strcmp(profiles[i].name, name) == 0) {
+      return &(profiles[i]);
+    }
+  }
+  return NULL;
+}
+
+const SysCallList *getProfileSysCallList(const SandboxProfile *profile) {
+
+  int i = profile - profiles;
+  // the server's workers may ask for the same profile at the same time
+  pthread_mutex_lock(&compiled_lock);
+  if (!is_compiled[i]) {
+    if (initSysCallList(
+      profile -> syscalls, profile -> syscalls_len, &(compiled[i])) == -1) {
+      pthread_mutex_unlock(&compiled_lock);
+      printErr(__FILE__, __LINE__, "initSysCallList failed", 0, 0);
+      return NULL;
+    }
+    is_compiled[i] = 1;
+  }
+  pthread_mutex_unlock(&compiled_lock);
+  return &(compiled[i]);
+}
+
+static const char *pick(const char *given, const char *def) {
+
+  return given == NULL || strcmp(given, "-") == 0 ? def : given;
+}
+
+void applyProfileLimits(const SandboxProfile *profile, ResLimits *res_lims) {
+
+  res_lims -> cpu_time = pick(res_lims -> cpu_time, profile -> limits.cpu_time);
+  res_lims -> mem = pick(res_lims -> mem, profile -> limits.mem);
+  res_lims -> num_tasks = pick(
+    res_lims -> num_tasks, profile -> limits.num_tasks);
+  res_lims -> output = pick(res_lims -> output, profile -> limits.output);
+  res_lims -> wall_time = pick(
+    res_lims -> wall_time, profile -> limits.wall_time);
+}
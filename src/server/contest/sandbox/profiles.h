@@ -0,0 +1,42 @@
+#ifndef PROFILES_H_
+#define PROFILES_H_
+
+#include "resource_limits.h"
+#include "syscall_manager.h"
+
+/*
+  A set of defaults for the executables of one language: the system calls
+  they may make and their resource limits. The tables live in 'profiles.c'
+  and are resolved by the compiler, so choosing a profile reads no file and
+  resolves no name.
+*/
+typedef struct SandboxProfile {
+  const char *name;
+  const int *syscalls; // in addition to the default whitelist
+  int syscalls_len;
+  ResLimits limits; // defaults for the fields given as "-"
+} SandboxProfile;
+
+/*
+  Returns:
+    NULL if there is no profile called |name|
+    the profile otherwise
+*/
+const SandboxProfile *findProfile(const char *name);
+
+/*
+  Returns:
+    NULL on error
+    the system call list of |profile| with its filter compiled. It is built
+    on first use and kept for the life of the process.
+*/
+const SysCallList *getProfileSysCallList(const SandboxProfile *profile);
+
+/*
+  Replaces every field of |res_lims| that is NULL or "-" by the default of
+  |profile|. The output and wall time limits stay NULL if the profile has
+  none.
+*/
+void applyProfileLimits(const SandboxProfile *profile, ResLimits *res_lims);
+
+#endif
@@ -0,0 +1,268 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdlib.h>
+#include <string.h> // strdup()
+
+#include "../sandbox.h"
+#include "../profiles.h"
+
+/*
+  The '_sandbox' extension module: 'sandboxExecBatch' and
+  'sandboxExecBatchProfile' for the judge, without 'sudo sandbox-exe' or the
+  sandbox server in between. The calling process needs the privileges
+  'sandbox-exe' has (root, or CAP_SYS_ADMIN, CAP_SYS_CHROOT, CAP_SETUID and
+  CAP_SETGID plus write access to the cgroups).
+
+    _sandbox.init(memory_cg, cpuacct_cg, pids_cg, uid, gid,
+                  pool_size=4, pool_refill=1)
+    _sandbox.run_batch(exect_path, jail_path, cases, mem, cpu_time,
+                       num_tasks, output=None, wall_time=None,
+                       profile=None, whitelist=None, on_result=None)
+      -> [{'verdict': .., 'cpu_time': .., ..., 'trace': {..}}, ...]
+    _sandbox.profile_limits(profile)
+      -> {'mem': .., 'cpu_time': .., 'num_tasks': .., 'output': ..,
+          'wall_time': ..}
+
+  'cases' is a sequence of (input_file, output_file). Exactly one of
+  'profile' and 'whitelist' is given. The GIL is released while the cases
+  run, so other threads of the judge keep going. 'on_result(i, result)' is
+  called as soon as case i ran, with the dict the list will hold; an
+  exception of it stops the calls and is raised once the batch is done.
+*/
+
+// Set once by 'init'. The cgroup pool is keyed by the address of the
+// 'CgroupLocs' it serves, hence a single one for the life of the process.
+static CgroupLocs cg_locs;
+static uid_t sb_uid;
+static gid_t sb_gid;
+static int initialized = 0;
+
+static PyObject *sandboxInit(PyObject *self, PyObject *args, PyObject *kw) {
+
+  static char *keywords[] = {
+    "memory_cg", "cpuacct_cg", "pids_cg", "uid", "gid", "pool_size",
+    "pool_refill", NULL};
+  const char *memory, *cpuacct, *pids;
+  unsigned int uid, gid;
+  int pool_size = 4, pool_refill = 1;
+  if (!PyArg_ParseTupleAndKeywords(args, kw, "sssII|ii", keywords,
+    &memory, &cpuacct, &pids, &uid, &gid, &pool_size, &pool_refill)) {
+    return NULL;
+  }
+  if (initialized) {
+    PyErr_SetString(PyExc_RuntimeError, "_sandbox.init was called already");
+    return NULL;
+  }
+  cg_locs.memory = strdup(memory);
+  cg_locs.cpuacct = strdup(cpuacct);
+  cg_locs.pids = strdup(pids);
+  cg_locs.cpuset = NULL;
+  // on a cgroup2 mount the same directory is expected for all three
+  cg_locs.unified = isUnifiedHierarchy(cg_locs.memory) ? cg_locs.memory : NULL;
+  cg_locs.pool_size = pool_size;
+  cg_locs.pool_refill = pool_refill;
+  sb_uid = uid;
+  sb_gid = gid;
+  initialized = 1;
+  Py_RETURN_NONE;
+}
+
+static PyObject *resultToDict(const SandboxResult *r) {
+
+  const SandboxTrace *t = &(r -> trace);
+  return Py_BuildValue("{s:i,s:L,s:L,s:L,s:L,s:i,s:i,s:L,"
+    "s:{s:L,s:L,s:L,s:L,s:L,s:L,s:L}}",
+    "verdict", r -> verdict, "cpu_time", r -> cpu_time,
+    "wall_time", r -> wall_time, "peak_mem", r -> peak_mem,
+    "peak_tasks", r -> peak_tasks, "exit_code", r -> exit_code,
+    "signal", r -> signal, "output_bytes", r -> output_bytes,
+    "trace", "clone", t -> clone, "ready", t -> ready, "limits", t -> limits,
+    "release", t -> release, "exit", t -> exit, "cleanup", t -> cleanup,
+    "judge_cpu", t -> judge_cpu);
+}
+
+// The 'on_result' of a batch and the first exception it raised
+typedef struct ResultCallback {
+  PyObject *fn;
+  PyObject *type, *value, *traceback;
+} ResultCallback;
+
+/*
+  'SandboxCaseDone' of 'run_batch'. Runs without the GIL, in the middle of
+  the batch, and takes it for the call.
+*/
+static void callOnResult(int index, const SandboxResult *result, void *arg) {
+
+  ResultCallback *cb = (ResultCallback *)arg;
+  PyGILState_STATE state = PyGILState_Ensure();
+  if (cb -> type == NULL) {
+    PyObject *d = resultToDict(result);
+    PyObject *ret = d == NULL ?
+      NULL : PyObject_CallFunction(cb -> fn, "iO", index, d);
+    if (ret == NULL) {
+      PyErr_Fetch(&(cb -> type), &(cb -> value), &(cb -> traceback));
+    }
+    Py_XDECREF(ret);
+    Py_XDECREF(d);
+  }
+  PyGILState_Release(state);
+}
+
+/*
+  Fills |jobs| from the sequence |cases|. The strings point into the
+  objects of |cases|, which must outlive |jobs|.
+*/
+static int parseCases(PyObject *cases, SandboxCase *jobs, Py_ssize_t len) {
+
+  Py_ssize_t i;
+  for (i = 0; i < len; i++) {
+    PyObject *c = PySequence_Fast_GET_ITEM(cases, i);
+    if (!PyArg_ParseTuple(
+      c, "ss;cases must hold (input_file, output_file) pairs",
+      &(jobs[i].input_file), &(jobs[i].output_file))) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static PyObject *sandboxRunBatch(
+  PyObject *self, PyObject *args, PyObject *kw) {
+
+  static char *keywords[] = {
+    "exect_path", "jail_path", "cases", "mem", "cpu_time", "num_tasks",
+    "output", "wall_time", "profile", "whitelist", "on_result", NULL};
+  const char *exect_path, *jail_path, *profile = NULL, *whitelist = NULL;
+  PyObject *cases_arg, *on_result = Py_None;
+  ResLimits lims;
+  lims.output = lims.wall_time = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kw, "ssOsss|zzzzO", keywords,
+    &exect_path, &jail_path, &cases_arg, &(lims.mem), &(lims.cpu_time),
+    &(lims.num_tasks), &(lims.output), &(lims.wall_time), &profile,
+    &whitelist, &on_result)) {
+    return NULL;
+  }
+  if (on_result != Py_None && !PyCallable_Check(on_result)) {
+    PyErr_SetString(PyExc_TypeError, "on_result must be callable");
+    return NULL;
+  }
+  if (!initialized) {
+    PyErr_SetString(PyExc_RuntimeError, "_sandbox.init was not called");
+    return NULL;
+  }
+  if ((profile == NULL) == (whitelist == NULL)) {
+    PyErr_SetString(
+      PyExc_ValueError, "exactly one of profile and whitelist is needed");
+    return NULL;
+  }
+
+  PyObject *cases = PySequence_Fast(cases_arg, "cases must be a sequence");
+  if (cases == NULL) {
+    return NULL;
+  }
+  Py_ssize_t len = PySequence_Fast_GET_SIZE(cases);
+  SandboxCase *jobs = PyMem_Malloc(sizeof(SandboxCase) * (len + 1));
+  SandboxResult *results = PyMem_Malloc(sizeof(SandboxResult) * (len + 1));
+  if (jobs == NULL || results == NULL) {
+    PyMem_Free(jobs);
+    PyMem_Free(results);
+    Py_DECREF(cases);
+    return PyErr_NoMemory();
+  }
+  PyObject *list = NULL;
+  ResultCallback cb = {on_result, NULL, NULL, NULL};
+  SandboxCaseDone done = on_result != Py_None ? callOnResult : NULL;
+  if (parseCases(cases, jobs, len) == 0) {
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = profile != NULL ?
+      sandboxExecBatchProfile(
+        exect_path, jail_path, jobs, (int)len, &cg_locs, &lims,
+        profile, sb_uid, sb_gid, results, done, &cb) :
+      sandboxExecBatch(
+        exect_path, jail_path, jobs, (int)len, &cg_locs, &lims,
+        whitelist, sb_uid, sb_gid, results, done, &cb);
+    Py_END_ALLOW_THREADS
+    Py_ssize_t i;
+    if (ret != SB_OK) {
+      // the batch was not set up, so 'on_result' was not called yet
+      for (i = 0; i < len; i++) {
+        failedSandboxResult(&(results[i]));
+        if (done != NULL) {
+          callOnResult((int)i, &(results[i]), &cb);
+        }
+      }
+    }
+    if (cb.type != NULL) {
+      PyErr_Restore(cb.type, cb.value, cb.traceback);
+      PyMem_Free(jobs);
+      PyMem_Free(results);
+      Py_DECREF(cases);
+      return NULL;
+    }
+    list = PyList_New(len);
+    for (i = 0; list != NULL && i < len; i++) {
+      PyObject *d = resultToDict(&(results[i]));
+      if (d == NULL) {
+        Py_CLEAR(list);
+        break;
+      }
+      PyList_SET_ITEM(list, i, d);
+    }
+  }
+  PyMem_Free(jobs);
+  PyMem_Free(results);
+  Py_DECREF(cases);
+  return list;
+}
+
+/*
+  The default limits of a language profile as strings, None for those it
+  does not set; what 'sandbox-exe --limits' prints.
+*/
+static PyObject *sandboxProfileLimits(PyObject *self, PyObject *args) {
+
+  const char *name;
+  if (!PyArg_ParseTuple(args, "s", &name)) {
+    return NULL;
+  }
+  const SandboxProfile *p = findProfile(name);
+  if (p == NULL) {
+    PyErr_Format(PyExc_ValueError, "no profile %s", name);
+    return NULL;
+  }
+  ResLimits r = {NULL, NULL, NULL, NULL, NULL};
+  applyProfileLimits(p, &r);
+  return Py_BuildValue("{s:s,s:s,s:s,s:z,s:z}", "mem", r.mem,
+    "cpu_time", r.cpu_time, "num_tasks", r.num_tasks, "output", r.output,
+    "wall_time", r.wall_time);
+}
+
+static PyMethodDef sandboxMethods[] = {
+  {"init", (PyCFunction)(void (*)(void))sandboxInit,
+    METH_VARARGS | METH_KEYWORDS,
+    "Sets the cgroups, uid and gid of all later runs"},
+  {"run_batch", (PyCFunction)(void (*)(void))sandboxRunBatch,
+    METH_VARARGS | METH_KEYWORDS,
+    "Runs an executable once per (input_file, output_file) case"},
+  {"profile_limits", sandboxProfileLimits, METH_VARARGS,
+    "Default limits of a language profile"},
+  {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef sandboxModule = {
+  PyModuleDef_HEAD_INIT, "_sandbox", "Bindings of the sandbox", -1,
+  sandboxMethods, NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit__sandbox(void) {
+
+  PyObject *m = PyModule_Create(&sandboxModule);
+  if (m == NULL) {
+    return NULL;
+  }
+  PyModule_AddIntConstant(m, "SB_OK", SB_OK);
+  PyModule_AddIntConstant(m, "SB_FAILURE", SB_FAILURE);
+  return m;
+}
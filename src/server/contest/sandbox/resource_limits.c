@@ -1,206 +1,171 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h> // malloc()
-#include <math.h> // log10(), ceil()
 #include <sys/types.h> // pid_t, SIGKILl, open()
-#include <sys/stat.h> // S_IRWXU, open()
+#include <sys/stat.h> // open()
 #include <sys/eventfd.h>
+#include <sys/epoll.h> // epoll_create1(), epoll_ctl(), epoll_wait()
+#include <sys/timerfd.h> // timerfd_create(), timerfd_settime()
+#include <sys/vfs.h> // statfs()
+#include <linux/magic.h> // CGROUP2_SUPER_MAGIC
 #include <signal.h>
 #include <errno.h>
 #include <fcntl.h> // open()
-#include <unistd.h> // close(), write()
+#include <unistd.h> // close(), write(), pread()
 #include <pthread.h>
-#include <time.h> // nanosleep()
+#include <stdint.h>
 
 #include "logger.h"
 #include "resource_limits.h"
 #include "terminate.h"
+#include "cgroup_pool.h"
 
-#define TIME_LIM_POLL_INTERVAL 100 // nanoseconds
-#define NUM_TASKS_LIM_POLL_INTERVAL 10 // nanoseconds
+// The cpu time timer never fires more often than this, which bounds both the
+// monitor's own cpu usage and how far past the limit a kill can land
+#define TIME_LIM_MIN_INTERVAL 1000000 // nanoseconds
 
-typedef struct MemListenerPayload {
-  int oomefd;
-  int mocfd;
-  int *exceeded;
-  char *pid_dir;
-  TerminatePayload *tp;
-} MemListenerPayload;
-
-typedef struct MemListenerCleanupPayload {
-  MemListenerPayload *mlp;
-} MemListenerCleanupPayload;
-
-typedef struct CpuTimeLimiterPayload {
-  int *exceeded;
-  const char *cpu_time;
-  char *pid_dir;
-  TerminatePayload *tp;
-} CpuTimeLimiterPayload;
-
-typedef struct CpuTimeLimiterCleanupPayload {
-  int fd;
-  CpuTimeLimiterPayload *ctlp;
-} CpuTimeLimiterCleanupPayload;
-
-typedef struct NumTasksListenerPayload {
+/*
+  Everything the monitor thread of one sandboxed executable needs. The fds
+  are -1 until opened.
+*/
+typedef struct MonitorPayload {
+  int epfd;
+  int oomefd; // v1: eventfd signalled by the memory cgroup on OOM
+             // v2: 'memory.events'
+  int mocfd; // v1: 'memory.oom_control', must stay open while 'oomefd' is
+             // used
+  int usagefd; // v1: 'cpuacct.usage', v2: 'cpu.stat'
+  int timerfd; // expires when the cpu time limit might have been reached
+  int eventsfd; // 'pids.events'
+  int walltimerfd; // expires when the wall time limit is reached
+  long long cpu_time;
+  long long num_tasks;
+  CgroupDirs *dirs;
   int *exceeded;
-  char *pid_dir;
   TerminatePayload *tp;
-} NumTasksListenerPayload;
-
-typedef struct NumTasksListenerCleanupPayload {
-  int fd;
-  char *pids_events_path;
-  NumTasksListenerPayload *ntlp;
-} NumTasksListenerCleanupPayload;
+} MonitorPayload;
 
 // ------------------------- Helper Functions - Begin -----------------------
 
 /*
-  Returns a pointer to an NTCS |cg|/|pid|.
-
-  Resource residue:
-    1 char malloc - 'pid_dir'
+  |pid| is written to |dir|/tasks
 */
-static char *getPidDir(const char *cg, pid_t pid) {
-  char *pid_dir = malloc(
-    sizeof(char) * (strlen(cg) + (int)ceil(log10(pid)) + 2));
-  sprintf(pid_dir, "%s/%d", cg, pid);
-  return pid_dir;
+static int addToTasksFile(const char *dir, pid_t pid) {
+
+  char buf[32];
+  sprintf(buf, "%d", pid);
+  if (writeCgroupFile(dir, "tasks", buf) == -1) {
+    printErr(__FILE__, __LINE__, "writeCgroupFile failed", 0, 0);
+    return -1;
+  }
+  return 0;
 }
 
 /*
-  Creates the directory |cg|/|pid| and returns a pointer to the NTCS
-  |cg|/|pid|
+  Reads the number at the start of the file |fd| refers to.
 
   Returns:
-    NULL on error
-    not NULL on success
-
-  Resource residue (when return value != NULL):
-    1 char malloc - 'pid_dir'
-    1 directory created - |pid_dir|
+    -1 on error
+    the number otherwise
 */
-static char *createPidDir(const char *cg, pid_t pid) {
+static long long readCounter(int fd) {
 
-  char *pid_dir = getPidDir(cg, pid);
-  // TODO: check what permissions are required
-  if (mkdir(pid_dir, S_IRWXU) == -1) {
-    printErr(__FILE__, __LINE__, "mkdir failed", 1, errno);
-    free(pid_dir);
-    return NULL;
+  char content[32];
+  ssize_t bytes_read = pread(fd, content, sizeof(content) - 1, 0);
+  if (bytes_read == -1) {
+    printErr(__FILE__, __LINE__, "pread failed", 1, errno);
+    return -1;
   }
-  return pid_dir;
+  content[bytes_read] = '\0';
+  return atoll(content);
 }
 
 /*
-  Writes |str| to the file |dir|/|file_name|
+  Finds the line "|key| <number>" in the flat keyed file |fd| refers to, for
+  instance 'usage_usec' in 'cpu.stat' or 'max' in 'pids.events'.
+
+  Returns:
+    -1 on error or if there is no such line
+    the number otherwise
 */
-static int writeToFile(
-  const char *dir, const char *file_name, const char *str) {
+static long long readKeyedCounter(int fd, const char *key) {
 
-  char *path = malloc(sizeof(char) * (strlen(dir) + strlen(file_name) + 2));
-  sprintf(path, "%s/%s", dir, file_name);
-  int f = open(path, O_WRONLY);
-  if (f == -1) {
-    printErr(__FILE__, __LINE__, "open failed", 1, errno);
-    free(path);
+  char content[1024];
+  ssize_t bytes_read = pread(fd, content, sizeof(content) - 1, 0);
+  if (bytes_read == -1) {
+    printErr(__FILE__, __LINE__, "pread failed", 1, errno);
     return -1;
   }
-  if (write(f, str, sizeof(char) * strlen(str)) == -1) {
-    printErr(__FILE__, __LINE__, "write failed", 1, errno);
-    free(path);
-    return -1;
+  content[bytes_read] = '\0';
+  size_t key_len = strlen(key);
+  char *line = content;
+  while (line != NULL && *line != '\0') {
+    if (strncmp(line, key, key_len) == 0 && line[key_len] == ' ') {
+      return atoll(line + key_len + 1);
+    }
+    if ((line = strchr(line, '\n')) != NULL) {
+      line++;
+    }
   }
-  if (close(f) == -1) {
-    printErr(__FILE__, __LINE__, "close failed", 1, errno);
-    free(path);
-    return -1;
+  return -1;
+}
+
+/*
+  Returns:
+    -1 on error
+    cpu time used by the sandboxed executable so far, in nanoseconds
+*/
+static long long readCpuUsage(const MonitorPayload *mp) {
+
+  if (mp -> dirs -> unified != NULL) {
+    // unlike 'cpuacct.usage', 'cpu.stat' cannot be reset between runs of a
+    // pool slot
+    long long usec = readKeyedCounter(mp -> usagefd, "usage_usec");
+    return usec == -1 ? -1 : usec * 1000 - mp -> dirs -> usage_base;
   }
-  free(path);
-  return 0;
+  return readCounter(mp -> usagefd);
 }
 
 /*
-  |pid| is written to |cg|/|pid|/tasks
+  Adds |fd| to the epoll instance |epfd| for |events|
 */
-static int addToTasksFile(const char *cg, pid_t pid) {
+static int watchFd(int epfd, int fd, uint32_t events) {
 
-  char *pid_dir = getPidDir(cg, pid);
-  char *buf = malloc((int)ceil(log10(pid)) + 1);
-  sprintf(buf, "%d", pid);
-  if (writeToFile(pid_dir, "tasks", buf) == -1) {
-    printErr(__FILE__, __LINE__, "writeToFile failed", 0, 0);
-    free(pid_dir);
-    free(buf);
+  struct epoll_event ev;
+  ev.events = events;
+  ev.data.fd = fd;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+    printErr(__FILE__, __LINE__, "epoll_ctl failed", 1, errno);
     return -1;
   }
-  free(pid_dir);
-  free(buf);
   return 0;
 }
 
-/*
-  Keeps reading from file descriptor |fd| at intervals of |interval| nanoseconds
+static void closeFd(int fd) {
 
-  Returns:
-    0 if the read string is greater than |lim|
-    -1 on error
+  if (fd != -1 && close(fd) == -1) {
+    printErr(__FILE__, __LINE__, "close failed", 1, errno);
+  }
+}
 
-    Note: The meaning of greater than depends on the value of 'type'. The read string
-    is greater than |lim| if
-      (for type == 1)
-        the number represented by the read string is > number represented by 'lim'
-      (for type != 1)
-        the read string is lexicographically greater then the string 'lim'
+/*
+  Closes the fds and frees the memory in |mp| and |mp| itself. The cgroup
+  directories are released only if |release_dirs| is non zero; otherwise
+  'terminate' takes care of them.
 */
-static int pollFileContent(
-  int fd, const char *lim, long long interval, int type) {
-
-  long long seconds = interval / 10e9;
-  long long nanoseconds = interval - seconds;
-  struct timespec req;
-  req.tv_sec = seconds;
-  req.tv_nsec = nanoseconds;
-
-  int content_max_size = 20;
-  char *content = malloc(sizeof(char) * content_max_size);
-  ssize_t bytes_read;
-  while (1) {
-    // content_max_len - 1 to accomodate a '\0'
-    if ((bytes_read = read(fd, content, content_max_size - 1)) == -1) {
-      printErr(__FILE__, __LINE__, "read failed", 1, errno);
-      free(content);
-      return -1;
-    }
-    // -1 to overwrite the trailing new line
-    content[bytes_read - 1] = '\0';
-    if (type == 1) {
-      if (atoll(content) > atoll(lim)) {
-        free(content);
-        return 0;
-      }
-    } else {
-      if (strcmp(content, lim) > 0) {
-        free(content);
-        return 0;
-      }
-    }
-
-    if (lseek(fd, 0, SEEK_SET) == -1) {
-      printErr(__FILE__, __LINE__, "lseek failed", 1, errno);
-      free(content);
-      return -1;
-    }
-
-    if (nanosleep(&req, NULL) == -1) {
-      printErr(__FILE__, __LINE__, "nanosleep interrupted by a signal \
-        handler or encountered an error", 1, errno);
-      free(content);
-      return -1;
-    }
-  }
+static void freeMonitorPayload(MonitorPayload *mp, int release_dirs) {
+
+  closeFd(mp -> epfd);
+  closeFd(mp -> oomefd);
+  closeFd(mp -> mocfd);
+  closeFd(mp -> usagefd);
+  closeFd(mp -> timerfd);
+  closeFd(mp -> eventsfd);
+  closeFd(mp -> walltimerfd);
+  if (release_dirs && releaseCgroupDirs(mp -> dirs) == -1) {
+    printErr(__FILE__, __LINE__, "releaseCgroupDirs failed", 0, 0);
+  }
+  free(mp);
 }
 
 // ------------------------- Helper Functions - End -----------------------
@@ -208,491 +173,594 @@ static int pollFileContent(
 // -------------------------- mem - begin -----------------------------------
 
 /*
-  Resource residue:
-    Note: Any residue in 'setMemLimit', except the created pid directory, and
-    'memListener' is removed here
+  Writes the limit to the memory cgroup directory of the run (swap and the
+  OOM killer are already disabled there, see 'configureDirs') and registers
+  'mp -> oomefd' for OOM notifications.
+
+  Returns:
+    -1 on any error
+    0 on success
+
+  Resource residue (always, released by 'freeMonitorPayload'):
+    'mp -> oomefd', 'mp -> mocfd' - open fd's
 */
-static void memListenerCleanup(void *arg) {
+static int setMemLimit(const char *mem, MonitorPayload *mp) {
 
-  MemListenerCleanupPayload *mlcp = (MemListenerCleanupPayload *) arg;
-  if (close(mlcp -> mlp -> oomefd) == -1) {
-    printErr(__FILE__, __LINE__, "close failed", 1, errno);
+  CgroupDirs *dirs = mp -> dirs;
+  char *pid_dir = dirs -> memory;
+  // limit is rounded to greatest multiple of page size smaller than
+  // |mem|, automatically
+  if (setCgroupLimit(
+    pid_dir, "memory.limit_in_bytes", mem, &(dirs -> mem)) == -1) {
+    printErr(__FILE__, __LINE__, "setCgroupLimit failed", 0, 0);
+    return -1;
   }
-  if (close(mlcp -> mlp -> mocfd) == -1) {
-    printErr(__FILE__, __LINE__, "close failed", 1, errno);
+
+  if ((mp -> oomefd = eventfd(0, EFD_CLOEXEC)) == -1) {
+    printErr(__FILE__, __LINE__, "eventfd failed", 1, errno);
+    return -1;
+  }
+  char moc_path[strlen(pid_dir) + 20];
+  sprintf(moc_path, "%s/memory.oom_control", pid_dir);
+  if ((mp -> mocfd = open(moc_path, O_RDONLY | O_CLOEXEC)) == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+    return -1;
+  }
+  char buf[32];
+  sprintf(buf, "%d %d", mp -> oomefd, mp -> mocfd);
+  if (writeCgroupFile(pid_dir, "cgroup.event_control", buf) == -1) {
+    printErr(__FILE__, __LINE__, "writeCgroupFile failed", 0, 0);
+    return -1;
   }
-  free(mlcp -> mlp -> pid_dir);
-  free(mlcp -> mlp);
-  free(mlcp);
+  return watchFd(mp -> epfd, mp -> oomefd, EPOLLIN);
 }
 
 /*
-  Listens for OOM killer notification
-
-  Resource residue:
-    Created here and removed by 'memListenerCleanup':
-      1 MemListenerCleanupPayload malloc
-
-    Note: Any residue in 'setMemLimit' (except the created pid directory) and here
-    is removed in 'memListenerCleanup'
+  Called when 'oomefd' is readable.
 */
-static void *memListener(void *arg) {
-
-  MemListenerPayload *mlp = (MemListenerPayload *)arg;
-  MemListenerCleanupPayload *cpl = malloc(sizeof(MemListenerCleanupPayload));
-  cpl -> mlp = mlp;
-  pthread_cleanup_push(memListenerCleanup, cpl);
-
+static int onOom(MonitorPayload *mp) {
+
+  if (mp -> dirs -> unified != NULL) {
+    // 'memory.events' also changes when the limit is merely reached and
+    // reclaim succeeds; only an OOM kill counts
+    long long oom_kill = readKeyedCounter(mp -> oomefd, "oom_kill");
+    if (oom_kill == -1) {
+      return FATAL_ERROR_EXCEED;
+    }
+    return oom_kill > mp -> dirs -> oom_kill_base ?
+      MEM_LIM_EXCEED : NO_EXCEED;
+  }
   uint64_t u;
-  ssize_t ret = read(mlp -> oomefd, &u, sizeof(uint64_t));
+  ssize_t ret = read(mp -> oomefd, &u, sizeof(uint64_t));
   if (ret == -1) {
     printErr(__FILE__, __LINE__, "read failed", 1, errno);
-    *(mlp -> exceeded) = FATAL_ERROR_EXCEED;
+    return FATAL_ERROR_EXCEED;
   } else if (ret != sizeof(uint64_t)) {
     printErr(__FILE__, __LINE__, "Unexpected return value from read", 1, errno);
-    *(mlp -> exceeded) = FATAL_ERROR_EXCEED;
-  } else {
-    *(mlp -> exceeded) = MEM_LIM_EXCEED;
+    return FATAL_ERROR_EXCEED;
   }
-  mlp -> tp -> skip = malloc(sizeof(pthread_t));
-  *(mlp -> tp -> skip) = pthread_self();
-  #ifdef SB_VERBOSE
-  printf("terminate called - memListener\n");
-  #endif
-  if (terminate(mlp -> tp) == -1) {
-    printErr(__FILE__, __LINE__, "terminate failed", 0, 0);
-  }
-  #ifdef SB_VERBOSE
-  printf("terminate returned - memListener\n");
-  #endif
+  return MEM_LIM_EXCEED;
+}
 
-  pthread_cleanup_pop(0);
-  pthread_exit(NULL);
+// ---------------- mem - end -----------------------------------------------
+
+// -----------------cpu_time - begin ----------------------------------------
+
+/*
+  Arms 'timerfd' to expire when the cpu time limit could have been reached
+  at the earliest, given |usage| nanoseconds were used already. Up to
+  'num_tasks' tasks may run at once, so the budget can be used up that many
+  times faster than wall-clock time passes.
+*/
+static int armCpuTimer(MonitorPayload *mp, long long usage) {
+
+  long long interval = (mp -> cpu_time - usage + 1) / mp -> num_tasks;
+  if (interval < TIME_LIM_MIN_INTERVAL) {
+    interval = TIME_LIM_MIN_INTERVAL;
+  }
+  struct itimerspec its;
+  its.it_interval.tv_sec = 0;
+  its.it_interval.tv_nsec = 0;
+  its.it_value.tv_sec = interval / 1000000000;
+  its.it_value.tv_nsec = interval % 1000000000;
+  if (timerfd_settime(mp -> timerfd, 0, &its, NULL) == -1) {
+    printErr(__FILE__, __LINE__, "timerfd_settime failed", 1, errno);
+    return -1;
+  }
+  return 0;
 }
 
 /*
-  Creates a memory pid directory, writes values to various files in this
-  memory cgroup and then creates a thread that starts listening for OOM
-  killer notification.
+  Opens 'cpuacct.usage' of the run and arms a timer for the monitor instead
+  of polling the file.
 
   Returns:
-    -1 on any error
+    -1 on error
     0 on success
 
-  Resource residue (when return value == 0):
-    1 directory created - |pid_dir|
-    1 char malloc - 'pid_dir'
-    2 open fd's - 'oomefd', 'mocfd'
-    1 MemListenerPayload malloc - 'mlp'
-    1 thread created
+  Resource residue (always, released by 'freeMonitorPayload'):
+    'mp -> usagefd', 'mp -> timerfd' - open fd's
 */
-static int setMemLimit(
-  pid_t pid, const char *mem, const char *memory_cg, int *exceeded,
-  pthread_t *thread, TerminatePayload *tp) {
-
-  char *pid_dir;
-  if ((pid_dir = createPidDir(memory_cg, pid)) == NULL) {
-    printErr(__FILE__, __LINE__, "createPidDir failed", 0, 0);
-    free(pid_dir);
-    return -1;
-  }
-  // disable swap for the sandboxed executable because mem limits on swap
-  // might not be available on all kernels
-  if (writeToFile(pid_dir, "memory.swappiness", "0") == -1) {
-    printErr(__FILE__, __LINE__, "writeToFile failed", 0, 0);
-    if (rmdir(pid_dir) == -1) {
-      printErr(__FILE__, __LINE__, "rmdir failed", 1, errno);
-    }
-    free(pid_dir);
+static int setCpuTimeLimit(const char *cpu_time, MonitorPayload *mp) {
+
+  char *dir = mp -> dirs -> cpuacct;
+  char usage_path[strlen(dir) + 15];
+  sprintf(usage_path, "%s/cpuacct.usage", dir);
+  if ((mp -> usagefd = open(usage_path, O_RDONLY | O_CLOEXEC)) == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
     return -1;
   }
-  // disable oom killer, hence the process will be paused when under oom
-  if (writeToFile(pid_dir, "memory.oom_control", "1") == -1) {
-    printErr(__FILE__, __LINE__, "writeToFile failed", 0, 0);
-    if (rmdir(pid_dir) == -1) {
-      printErr(__FILE__, __LINE__, "rmdir failed", 1, errno);
-    }
-    free(pid_dir);
+  mp -> timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (mp -> timerfd == -1) {
+    printErr(__FILE__, __LINE__, "timerfd_create failed", 1, errno);
     return -1;
   }
-  // limit is rounded to greatest multiple of page size smaller than
-  // |mem|, automatically
-  if (writeToFile(pid_dir, "memory.limit_in_bytes", mem) == -1) {
-    printErr(__FILE__, __LINE__, "writeToFile failed", 0, 0);
-    if (rmdir(pid_dir) == -1) {
-      printErr(__FILE__, __LINE__, "rmdir failed", 1, errno);
-    }
-    free(pid_dir);
+  mp -> cpu_time = atoll(cpu_time);
+  if (armCpuTimer(mp, 0) == -1) {
     return -1;
   }
+  return watchFd(mp -> epfd, mp -> timerfd, EPOLLIN);
+}
 
-  int oomefd = eventfd(0, 0);
-  char *moc_path = malloc(sizeof(char) * (strlen(pid_dir) + 20));
-  sprintf(moc_path, "%s/memory.oom_control", pid_dir);
-  int mocfd = open(moc_path, O_RDONLY);
-  char *buf = malloc((int)ceil(log10(oomefd)) + (int)ceil(log10(mocfd)) + 2);
-  sprintf(buf, "%d %d", oomefd, mocfd);
-  free(moc_path);
-  if (writeToFile(pid_dir, "cgroup.event_control", buf) == -1) {
-    free(buf);
-    printErr(__FILE__, __LINE__, "writeToFile failed", 0, 0);
-    if (close(oomefd) == -1) {
-      printErr(__FILE__, __LINE__, "close failed", 1, errno);
-    }
-    if (close(mocfd) == -1) {
-      printErr(__FILE__, __LINE__, "close failed", 1, errno);
-    }
-    if (rmdir(pid_dir) == -1) {
-      printErr(__FILE__, __LINE__, "rmdir failed", 1, errno);
-    }
-    free(pid_dir);
-    return -1;
-  }
-  free(buf);
+/*
+  Called when 'timerfd' expires: checks 'cpuacct.usage' and either reports
+  the limit as exceeded or re-arms the timer for the remaining budget.
+*/
+static int onCpuTimer(MonitorPayload *mp) {
 
-  MemListenerPayload *mlp = malloc(sizeof(MemListenerPayload));
-  mlp -> oomefd = oomefd;
-  mlp -> mocfd = mocfd;
-  mlp -> exceeded = exceeded;
-  mlp -> pid_dir = pid_dir;
-  mlp -> tp = tp;
-  pthread_create(thread, NULL, memListener, mlp);
-  return 0;
+  uint64_t expirations;
+  if (read(mp -> timerfd, &expirations, sizeof(uint64_t)) == -1) {
+    printErr(__FILE__, __LINE__, "read failed", 1, errno);
+    return FATAL_ERROR_EXCEED;
+  }
+  long long usage = readCpuUsage(mp);
+  if (usage == -1) {
+    return FATAL_ERROR_EXCEED;
+  }
+  if (usage > mp -> cpu_time) {
+    return TIME_LIM_EXCEED;
+  }
+  if (armCpuTimer(mp, usage) == -1) {
+    return FATAL_ERROR_EXCEED;
+  }
+  return NO_EXCEED;
 }
 
-// ---------------- mem - end -----------------------------------------------
+// -----------------cpu_time - end ------------------------------------------
 
-// -----------------cpu_time - begin ----------------------------------------
+// -----------------wall_time - begin ---------------------------------------
 
 /*
-  Resource residue:
-    Note: Any residue in 'setCpuTimeLimit' (except the created pid directory)
-    and 'cpuTimeLimiter' is removed here.
+  Arms a one-shot timer for |wall_time| nanoseconds from now. Unlike the cpu
+  timer it never needs re-arming: the limit holds whatever the executable
+  does, so it also ends runs that sleep or block on a read.
+
+  Returns:
+    -1 on error
+    0 on success
+
+  Resource residue (always, released by 'freeMonitorPayload'):
+    'mp -> walltimerfd' - open fd
 */
-static void cpuTimeLimiterCleanup(void *arg) {
+static int setWallTimeLimit(const char *wall_time, MonitorPayload *mp) {
 
-  CpuTimeLimiterCleanupPayload *ctlcp = (CpuTimeLimiterCleanupPayload *)arg;
-  if (ctlcp -> fd != -1) {
-    if (close(ctlcp -> fd) == -1) {
-      printErr(__FILE__, __LINE__, "close failed", 1, errno);
-    }
+  long long limit = atoll(wall_time);
+  mp -> walltimerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (mp -> walltimerfd == -1) {
+    printErr(__FILE__, __LINE__, "timerfd_create failed", 1, errno);
+    return -1;
+  }
+  struct itimerspec its;
+  its.it_interval.tv_sec = 0;
+  its.it_interval.tv_nsec = 0;
+  // a zero 'it_value' would disarm the timer
+  its.it_value.tv_sec = limit / 1000000000;
+  its.it_value.tv_nsec = limit > 0 ? limit % 1000000000 : 1;
+  if (timerfd_settime(mp -> walltimerfd, 0, &its, NULL) == -1) {
+    printErr(__FILE__, __LINE__, "timerfd_settime failed", 1, errno);
+    return -1;
   }
-  free(ctlcp -> ctlp -> pid_dir);
-  free(ctlcp -> ctlp);
-  free(ctlcp);
+  return watchFd(mp -> epfd, mp -> walltimerfd, EPOLLIN);
 }
 
-/*
-  Polls the 'cpuacct.usage' file and uses 'terminate' if cpu time exceeds the
-  limit.
+// -----------------wall_time - end -----------------------------------------
 
-  Resource residue:
-    Created here and removed by 'cpuTimeLimiterCleanup':
-      1 fd - 'fd'
-      1 CpuTimeLimiterCleanupPayload malloc - 'ctlcp'
-    Note: Any residue in 'setCpuTimeLimit' (except the created pid directory) and here
-    is removed in 'cpuTimeLimiterCleanup'
-*/
-static void *cpuTimeLimiter(void *arg) {
-
-  CpuTimeLimiterPayload *ctlp = (CpuTimeLimiterPayload *) arg;
+// -----------------num_tasks - begin ---------------------------------------
 
-  char *cpuacct_usage_path = malloc(
-    sizeof(char) * (strlen(ctlp -> pid_dir) + 15));
-  sprintf(cpuacct_usage_path, "%s/cpuacct.usage", ctlp -> pid_dir);
-  int fd = open(cpuacct_usage_path, O_RDONLY);
-  free(cpuacct_usage_path);
+/*
+  Writes the limit to the pids cgroup directory of the run and watches
+  'pids.events', which the kernel notifies (POLLPRI) when a fork fails
+  because of the limit.
 
-  // Set up cleanup handler
-  CpuTimeLimiterCleanupPayload *ctlcp = malloc(
-    sizeof(CpuTimeLimiterCleanupPayload));
-  ctlcp -> fd = fd;
-  ctlcp -> ctlp = ctlp;
-  pthread_cleanup_push(cpuTimeLimiterCleanup, ctlcp);
+  Returns:
+    -1 on error
+    0 on success
 
-  if (fd == -1) {
-    printErr(__FILE__, __LINE__, "open failed", 1, errno);
-    *(ctlp -> exceeded) = FATAL_ERROR_EXCEED;
-
-    ctlp -> tp -> skip = malloc(sizeof(pthread_t));
-    *(ctlp -> tp -> skip) = pthread_self();
-    #ifdef SB_VERBOSE
-    printf("terminate called - cpuTimeLimiter 1\n");
-    #endif
-    if (terminate(ctlp -> tp)== -1) {
-      printErr(__FILE__, __LINE__, "terminate failed", 0, 0);
-    }
-    #ifdef SB_VERBOSE
-    printf("terminate returned - cpuTimeLimiter 1\n");
-    #endif
+  Resource residue (always, released by 'freeMonitorPayload'):
+    'mp -> eventsfd' - open fd
+*/
+static int setNumTasksLimit(const char *num_tasks, MonitorPayload *mp) {
 
-    pthread_exit(NULL);
+  CgroupDirs *dirs = mp -> dirs;
+  // Set the limit
+  if (setCgroupLimit(
+    dirs -> pids, "pids.max", num_tasks, &(dirs -> num_tasks)) == -1) {
+    printErr(__FILE__, __LINE__, "setCgroupLimit failed", 0, 0);
+    return -1;
+  }
+  mp -> num_tasks = atoll(num_tasks);
+  if (mp -> num_tasks < 1) {
+    mp -> num_tasks = 1;
   }
 
-  // Blocks until time limit exceeds
-  if (pollFileContent(fd, ctlp -> cpu_time, TIME_LIM_POLL_INTERVAL, 1) == -1) {
-    *(ctlp -> exceeded) = FATAL_ERROR_EXCEED;
-  } else {
-    *(ctlp -> exceeded) = TIME_LIM_EXCEED;
+  // When a fork would cause number of pids allotted to exceed the pids
+  // controller will cause the call to fail but does not terminate
+  // any process. The monitor serves to notify when a process tries to
+  // exceed its allotted limit and also use 'terminate' which terminates
+  // the sanboxed executable.
+  // The takeaway is that enforcement of the limit is performed by the
+  // controller itself like the case of enforcing memory limit and unlike
+  // the case of enforcing CPU time limit.
+  char events_path[strlen(dirs -> pids) + 13];
+  sprintf(events_path, "%s/pids.events", dirs -> pids);
+  if ((mp -> eventsfd = open(events_path, O_RDONLY | O_CLOEXEC)) == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+    return -1;
+  }
+  // a pool slot keeps the count of its earlier runs
+  dirs -> pids_max_base = readKeyedCounter(mp -> eventsfd, "max");
+  if (dirs -> pids_max_base == -1) {
+    printErr(__FILE__, __LINE__, "readKeyedCounter failed", 0, 0);
+    return -1;
   }
+  return watchFd(mp -> epfd, mp -> eventsfd, EPOLLPRI);
+}
 
-  ctlp -> tp -> skip = malloc(sizeof(pthread_t));
-  *(ctlp -> tp -> skip) = pthread_self();
-  #ifdef SB_VERBOSE
-  printf("terminate called - cpuTimeLimiter 2\n");
-  #endif
-  if (terminate(ctlp -> tp) == -1) {
-    printErr(__FILE__, __LINE__, "terminate failed", 0, 0);
+/*
+  Called when 'pids.events' changed. The attempt to exceed the limit shows
+  as the value beside 'max' growing, for instance from 'max 0' to 'max 1'
+*/
+static int onPidsEvent(MonitorPayload *mp) {
+
+  long long max = readKeyedCounter(mp -> eventsfd, "max");
+  if (max == -1) {
+    printErr(__FILE__, __LINE__, "readKeyedCounter failed", 0, 0);
+    return FATAL_ERROR_EXCEED;
   }
-  #ifdef SB_VERBOSE
-  printf("terminate returned - cpuTimeLimiter 2\n");
-  #endif
+  return max > mp -> dirs -> pids_max_base ? TASK_LIM_EXCEED : NO_EXCEED;
+}
 
-  pthread_cleanup_pop(0);
-  pthread_exit(NULL);
+// -----------------num_tasks - end ------------------------------------------
+
+// -----------------unified - begin ------------------------------------------
+
+/*
+  Opens |dir|/|file_name| for reading.
+*/
+static int openInDir(const char *dir, const char *file_name) {
+
+  char path[strlen(dir) + strlen(file_name) + 2];
+  sprintf(path, "%s/%s", dir, file_name);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+  }
+  return fd;
 }
 
 /*
-  Creates a new pid directory and creates a new thread that enforces the time
-  limit.
+  cgroup v2 counterpart of 'setMemLimit', 'setCpuTimeLimit' and
+  'setNumTasksLimit': one directory holds all the limits and all the files
+  the monitor watches.
 
   Returns:
     -1 on error
     0 on success
 
-  Resource residue (when return value == 0):
-    1 char malloc - 'pid_dir'
-    1 directory created - |pid_dir|
-    1 CpuTimeLimiterPayload malloc - 'ctlp'
-    1 thread
+  Resource residue (always, released by 'freeMonitorPayload'):
+    'mp -> oomefd', 'mp -> usagefd', 'mp -> timerfd', 'mp -> eventsfd' -
+    open fd's
 */
-static int setCpuTimeLimit(
-  pid_t pid, const char *cpu_time, const char *cpuacct_cg, int *exceeded,
-  pthread_t *thread, TerminatePayload *tp) {
+static int setUnifiedLimits(
+  pid_t pid, const ResLimits *res_limits, MonitorPayload *mp) {
+
+  CgroupDirs *dirs = mp -> dirs;
+  char *dir = dirs -> unified;
+  // limit is rounded down to a multiple of page size, automatically
+  if (setCgroupLimit(
+      dir, "memory.max", res_limits -> mem, &(dirs -> mem)) == -1 ||
+    setCgroupLimit(
+      dir, "pids.max", res_limits -> num_tasks, &(dirs -> num_tasks)) == -1) {
+    printErr(__FILE__, __LINE__, "setCgroupLimit failed", 0, 0);
+    return -1;
+  }
 
-  char *pid_dir;
-  if ((pid_dir = createPidDir(cpuacct_cg, pid)) == NULL) {
-    printErr(__FILE__, __LINE__, "createPidDir failed", 0, 0);
-    free(pid_dir);
+  if ((mp -> oomefd = openInDir(dir, "memory.events")) == -1 ||
+    (mp -> usagefd = openInDir(dir, "cpu.stat")) == -1 ||
+    (mp -> eventsfd = openInDir(dir, "pids.events")) == -1) {
+    return -1;
+  }
+  // the counters of a pool slot keep counting across runs
+  long long usec;
+  dirs -> oom_kill_base = readKeyedCounter(mp -> oomefd, "oom_kill");
+  if (dirs -> oom_kill_base == -1 ||
+    (dirs -> pids_max_base = readKeyedCounter(mp -> eventsfd, "max")) == -1 ||
+    (usec = readKeyedCounter(mp -> usagefd, "usage_usec")) == -1) {
+    printErr(__FILE__, __LINE__, "readKeyedCounter failed", 0, 0);
+    return -1;
+  }
+  dirs -> usage_base = usec * 1000;
+  mp -> timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (mp -> timerfd == -1) {
+    printErr(__FILE__, __LINE__, "timerfd_create failed", 1, errno);
+    return -1;
+  }
+  mp -> cpu_time = atoll(res_limits -> cpu_time);
+  // 'cpu.max' keeps the run to one CPU regardless of the number of tasks
+  mp -> num_tasks = 1;
+  if (armCpuTimer(mp, 0) == -1) {
+    return -1;
+  }
+  if (watchFd(mp -> epfd, mp -> oomefd, EPOLLPRI) == -1 ||
+    watchFd(mp -> epfd, mp -> timerfd, EPOLLIN) == -1 ||
+    watchFd(mp -> epfd, mp -> eventsfd, EPOLLPRI) == -1) {
     return -1;
   }
 
-  CpuTimeLimiterPayload *ctlp = malloc(sizeof(CpuTimeLimiterPayload));
-  ctlp -> exceeded = exceeded;
-  ctlp -> cpu_time = cpu_time;
-  ctlp -> pid_dir = pid_dir;
-  ctlp -> tp = tp;
-  pthread_create(thread, NULL, cpuTimeLimiter, ctlp);
+  char buf[32];
+  sprintf(buf, "%d", pid);
+  if (writeCgroupFile(dir, "cgroup.procs", buf) == -1) {
+    printErr(__FILE__, __LINE__, "writeCgroupFile failed", 0, 0);
+    return -1;
+  }
   return 0;
 }
 
-// -----------------cpu_time - end ------------------------------------------
+int isUnifiedHierarchy(const char *dir) {
 
-// -----------------num_tasks - begin ---------------------------------------
+  struct statfs sfs;
+  if (statfs(dir, &sfs) == -1) {
+    printErr(__FILE__, __LINE__, "statfs failed", 1, errno);
+    return 0;
+  }
+  return sfs.f_type == CGROUP2_SUPER_MAGIC;
+}
 
-/*
-  Note: Any residue in 'setNumTasksLimit' (except the created pid
-  directory) and in 'numTasksListener' is removed here
-*/
-static void numTasksListenerCleanup(void *arg) {
+int checkMemExceeded(const TerminatePayload *tp) {
 
-  NumTasksListenerCleanupPayload *ntlcp = (NumTasksListenerCleanupPayload *)arg;
-  if (ntlcp -> fd != -1) {
-    if (close(ntlcp -> fd) == -1) {
-      printErr(__FILE__, __LINE__, "close failed", 1, errno);
-    }
+  if (tp -> dirs -> unified == NULL) {
+    return NO_EXCEED;
   }
-  free(ntlcp -> ntlp -> pid_dir);
-  free(ntlcp -> ntlp);
-  free(ntlcp);
+  int fd = openInDir(tp -> dirs -> unified, "memory.events");
+  if (fd == -1) {
+    return NO_EXCEED;
+  }
+  long long oom_kill = readKeyedCounter(fd, "oom_kill");
+  closeFd(fd);
+  return oom_kill > tp -> dirs -> oom_kill_base ? MEM_LIM_EXCEED : NO_EXCEED;
 }
 
 /*
-  Polls 'pids.events' file to know if there was an attempt by the sandboxed
-  executable to exceed the limit. This could be detected if the file content
-  has a non zero value beside 'max', for instance 'max 1'
+  Reads the counter |file_name| (or the line |key| in it, if not NULL) of the
+  cgroup directory |dir|.
 
-  Resource residue:
-    Created here but removed by 'numTasksListenerCleanup':
-      1 fd - 'fd'
-      1 NumTasksListenerCleanupPayload malloc - 'ntlcp'
-    Note: Any residue in 'setNumTasksLimit' (except the created pid
-    directory) and here is removed in 'numTasksListenerCleanup'
+  Returns:
+    -1 on error or if the kernel has no such file
+    the number otherwise
 */
-static void *numTasksListener(void *arg) {
-
-  NumTasksListenerPayload *ntlp = (NumTasksListenerPayload *) arg;
-  char *pids_events_path = malloc(
-    sizeof(char) * (strlen(ntlp -> pid_dir) + 13));
-  sprintf(pids_events_path, "%s/pids.events", ntlp -> pid_dir);
-  int fd = open(pids_events_path, O_RDONLY);
-  free(pids_events_path);
-
-  // Setup the cleanup handler
-  NumTasksListenerCleanupPayload *ntlcp = malloc(
-    sizeof(NumTasksListenerCleanupPayload));
-  ntlcp -> fd = fd;
-  ntlcp -> ntlp = ntlp;
-  pthread_cleanup_push(numTasksListenerCleanup, ntlcp);
+static long long readDirCounter(
+  const char *dir, const char *file_name, const char *key) {
 
+  char path[strlen(dir) + strlen(file_name) + 2];
+  sprintf(path, "%s/%s", dir, file_name);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
   if (fd == -1) {
-    printErr(__FILE__, __LINE__, "open failed", 1, errno);
-
-    *(ntlp -> exceeded) = FATAL_ERROR_EXCEED;
-
-    ntlp -> tp -> skip = malloc(sizeof(pthread_t));
-    *(ntlp -> tp -> skip) = pthread_self();
-    #ifdef SB_VERBOSE
-    printf("terminate called - numTasksListener 1\n");
-    #endif
-    if (terminate(ntlp -> tp) == -1) {
-      printErr(__FILE__, __LINE__, "terminate failed", 0, 0);
+    // e.g. 'pids.peak' needs Linux 6.13
+    if (errno != ENOENT) {
+      printErr(__FILE__, __LINE__, "open failed", 1, errno);
     }
-    #ifdef SB_VERBOSE
-    printf("terminate returned - numTasksListener 1\n");
-    #endif
-
-    pthread_exit(NULL);
+    return -1;
   }
+  long long value = key != NULL ? readKeyedCounter(fd, key) : readCounter(fd);
+  closeFd(fd);
+  return value;
+}
 
-  // Blocks until num tasks exceeds according to pids.events file
-  if (pollFileContent(fd, "max 0", NUM_TASKS_LIM_POLL_INTERVAL, 2) == -1) {
-    *(ntlp -> exceeded) = FATAL_ERROR_EXCEED;
+int readRunUsage(const TerminatePayload *tp, RunUsage *usage) {
+
+  const CgroupDirs *dirs = tp -> dirs;
+  if (dirs -> unified != NULL) {
+    long long usec = readDirCounter(dirs -> unified, "cpu.stat", "usage_usec");
+    usage -> cpu_time = usec == -1 ? -1 : usec * 1000 - dirs -> usage_base;
   } else {
-    *(ntlp -> exceeded) = TASK_LIM_EXCEED;
+    usage -> cpu_time = readDirCounter(dirs -> cpuacct, "cpuacct.usage", NULL);
+  }
+  // The peaks are high-water marks; only v1 'memory.max_usage_in_bytes' can
+  // be reset, so in a pool slot the others would include earlier runs
+  usage -> peak_mem = usage -> peak_tasks = -1;
+  if (dirs -> unified == NULL) {
+    usage -> peak_mem = readDirCounter(
+      dirs -> memory, "memory.max_usage_in_bytes", NULL);
+  } else if (!(dirs -> pooled)) {
+    usage -> peak_mem = readDirCounter(dirs -> unified, "memory.peak", NULL);
+  }
+  if (!(dirs -> pooled)) {
+    usage -> peak_tasks = readDirCounter(
+      dirs -> unified != NULL ? dirs -> unified : dirs -> pids,
+      "pids.peak", NULL);
+  }
+  return usage -> cpu_time == -1 ? -1 : 0;
+}
+
+// -----------------unified - end --------------------------------------------
+
+// -----------------monitor - begin ------------------------------------------
+
+static void monitorCleanup(void *arg) {
+
+  freeMonitorPayload((MonitorPayload *)arg, 0);
+}
+
+/*
+  The only thread per sandboxed executable. Sleeps in 'epoll_wait' until
+  one of the limits is hit and then uses 'terminate'. Costs no cpu time
+  while the limits hold, apart from the occasional cpu timer expiry.
+
+  Resource residue:
+    Note: Everything in 'mp' is released by 'monitorCleanup', on
+    cancellation as well as when the thread returns
+*/
+static void *monitor(void *arg) {
+
+  MonitorPayload *mp = (MonitorPayload *)arg;
+  pthread_cleanup_push(monitorCleanup, mp);
+
+  int exceeded = NO_EXCEED;
+  struct epoll_event ev;
+  while (exceeded == NO_EXCEED) {
+    int n = epoll_wait(mp -> epfd, &ev, 1, -1);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printErr(__FILE__, __LINE__, "epoll_wait failed", 1, errno);
+      exceeded = FATAL_ERROR_EXCEED;
+    } else if (ev.data.fd == mp -> oomefd) {
+      exceeded = onOom(mp);
+    } else if (ev.data.fd == mp -> timerfd) {
+      exceeded = onCpuTimer(mp);
+    } else if (ev.data.fd == mp -> eventsfd) {
+      exceeded = onPidsEvent(mp);
+    } else if (ev.data.fd == mp -> walltimerfd) {
+      exceeded = WALL_LIM_EXCEED;
+    }
   }
+  *(mp -> exceeded) = exceeded;
 
-  ntlp -> tp -> skip = malloc(sizeof(pthread_t));
-  *(ntlp -> tp -> skip) = pthread_self();
   #ifdef SB_VERBOSE
-  printf("terminate called - numTasksListener 2\n");
+  printf("terminate called - monitor\n");
   #endif
-  if (terminate(ntlp -> tp) == -1) {
+  if (terminate(mp -> tp) == -1) {
     printErr(__FILE__, __LINE__, "terminate failed", 0, 0);
   }
   #ifdef SB_VERBOSE
-  printf("terminate returned - numTasksListener 2\n");
+  printf("terminate returned - monitor\n");
   #endif
 
-  pthread_cleanup_pop(0);
+  pthread_cleanup_pop(1);
   pthread_exit(NULL);
 }
 
+// -----------------monitor - end --------------------------------------------
+
 /*
-  Creates a new pid directory, writes the limit to a file and creates a
-  thread that notifies when the limit exceeds.
+  Sets the limits in the three cgroup v1 hierarchies.
 
   Returns:
     -1 on error
     0 on success
 
-  Resource residue (if returned value == 0):
-    1 char malloc - 'pid_dir'
-    1 created directory - |pid_dir|
-    1 NumTasksListenerPayload malloc - 'ntlp'
-    1 thread
+  Resource residue (always, released by 'freeMonitorPayload'):
+    see 'setMemLimit', 'setCpuTimeLimit' and 'setNumTasksLimit'
 */
-static int setNumTasksLimit(
-  pid_t pid, const char *num_tasks, const char *pids_cg, int *exceeded,
-  pthread_t *thread, TerminatePayload *tp) {
+static int setV1Limits(
+  pid_t pid, const ResLimits *res_limits, MonitorPayload *mp) {
 
-  char *pid_dir;
-  if ((pid_dir = createPidDir(pids_cg, pid)) == NULL) {
-    printErr(__FILE__, __LINE__, "createPidDir failed", 0, 0);
-    free(pid_dir);
+  if (setMemLimit(res_limits -> mem, mp) == -1) {
+    printErr(__FILE__, __LINE__, "setMemLimit failed", 0, 0);
     return -1;
   }
-
-  // Set the limit
-  if (writeToFile(pid_dir, "pids.max", num_tasks) == -1) {
-    printErr(__FILE__, __LINE__, "writeToFile failed", 0, 0);
-    if (rmdir(pid_dir) == -1) {
-      printErr(__FILE__, __LINE__, "rmdir failed", 1, errno);
-    }
+  if (setCpuTimeLimit(res_limits -> cpu_time, mp) == -1) {
+    printErr(__FILE__, __LINE__, "setCpuTimeLimit failed", 0, 0);
+    return -1;
+  }
+  if (setNumTasksLimit(res_limits -> num_tasks, mp) == -1) {
+    printErr(__FILE__, __LINE__, "setNumTasksLimit failed", 0, 0);
     return -1;
   }
 
-  // When a fork would cause number of pids allotted to exceed the pids
-  // controller will cause the call to fail but does not terminate
-  // any process. The 'numTasksListener' serves to notify when a process
-  // tries to exceed its allotted limit and also use 'terminate' which
-  // terminates the sanboxed executable and also the resource limiter
-  // threads.
-  // The takeaway is that enforcement of the limit is performed by the
-  // controller itself like the case of enforcing memory limit and unlike
-  // the case of enforcing CPU time limit.
-  NumTasksListenerPayload *ntlp = malloc(sizeof(NumTasksListenerPayload));
-  ntlp -> pid_dir = pid_dir;
-  ntlp -> exceeded = exceeded;
-  ntlp -> tp = tp;
-  pthread_create(thread, NULL, numTasksListener, ntlp);
+  if (addToTasksFile(mp -> dirs -> memory, pid) == -1 ||
+    addToTasksFile(mp -> dirs -> cpuacct, pid) == -1 ||
+    addToTasksFile(mp -> dirs -> pids, pid) == -1) {
+    printErr(__FILE__, __LINE__, "addToTasksFile failed", 0, 0);
+    return -1;
+  }
   return 0;
 }
 
-// -----------------num_tasks - end ------------------------------------------
-
 /*
   Returns:
     0 on successfully setting limits
-    -1 on failure
+    -1 on failure; nothing is left behind and '*pl' is set to NULL
 
-  Errors ocurring during running of the threads are registered by setting
-  '*exceeded' appropriately as these might occur after 'set*Limit'
-  function returns thus reflecting this error in the return value of
-  'set*Limit' would not be possible.
+  Errors ocurring while the monitor runs are registered by setting
+  '*exceeded' appropriately as these might occur after this function
+  returns.
 
   '*exceeded' == FATAL_ERROR_EXCEED when an error causes the sandbox to be non
-  functional. Now, the sanboxed executable is killed, all resource limiter
-  threads are terminated.
+  functional. Now, the sanboxed executable is killed and the monitor thread
+  is terminated.
 */
 int setResourceLimits(
   pid_t pid, const ResLimits *res_limits, const CgroupLocs *cg_locs,
   int *exceeded, TerminatePayload **pl) {
 
-  TerminatePayload *tp = malloc(sizeof(TerminatePayload));
-  tp -> cg_locs = cg_locs;
-  tp -> pid = pid;
-  tp -> threads_len = 3;
-  tp -> skip = NULL;
-  tp -> terminated = 0;
-  tp -> done = 0;
-  tp -> once = 0;
-  pthread_t *threads = malloc(sizeof(pthread_t) * (tp -> threads_len));
-  tp -> threads = threads;
-  *pl = tp;
-
-  if (setMemLimit(
-    pid, res_limits -> mem, cg_locs -> memory, exceeded,
-    &threads[0], tp) == -1) {
-    printErr(__FILE__, __LINE__, "setMemLimit failed", 0, 0);
-    return -1;
-  }
-
-  if (setCpuTimeLimit(
-    pid, res_limits -> cpu_time, cg_locs -> cpuacct, exceeded,
-    &threads[1], tp) == -1) {
-    printErr(__FILE__, __LINE__, "setCpuTimeLimit failed", 0, 0);
+  MonitorPayload *mp = malloc(sizeof(MonitorPayload));
+  mp -> oomefd = mp -> mocfd = mp -> usagefd = -1;
+  mp -> timerfd = mp -> eventsfd = mp -> walltimerfd = -1;
+  mp -> exceeded = exceeded;
+  if ((mp -> dirs = acquireCgroupDirs(cg_locs, pid)) == NULL) {
+    printErr(__FILE__, __LINE__, "acquireCgroupDirs failed", 0, 0);
+    free(mp);
+    *pl = NULL;
     return -1;
   }
-
-  if (setNumTasksLimit(
-    pid, res_limits -> num_tasks, cg_locs -> pids, exceeded,
-    &threads[2], tp) == -1) {
-    printErr(__FILE__, __LINE__, "setNumTasksLimit failed", 0, 0);
+  if ((mp -> epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+    printErr(__FILE__, __LINE__, "epoll_create1 failed", 1, errno);
+    freeMonitorPayload(mp, 1);
+    *pl = NULL;
     return -1;
   }
 
-  if (addToTasksFile(cg_locs -> memory, pid) == -1) {
-    printErr(__FILE__, __LINE__, "addToTasksFile failed", 0, 0);
+  if (mp -> dirs -> unified != NULL) {
+    if (setUnifiedLimits(pid, res_limits, mp) == -1) {
+      printErr(__FILE__, __LINE__, "setUnifiedLimits failed", 0, 0);
+      freeMonitorPayload(mp, 1);
+      *pl = NULL;
+      return -1;
+    }
+  } else if (setV1Limits(pid, res_limits, mp) == -1) {
+    freeMonitorPayload(mp, 1);
+    *pl = NULL;
     return -1;
   }
-  if (addToTasksFile(cg_locs -> cpuacct, pid) == -1) {
-    printErr(__FILE__, __LINE__, "addToTasksFile failed", 0, 0);
+  if (res_limits -> wall_time != NULL &&
+    setWallTimeLimit(res_limits -> wall_time, mp) == -1) {
+    printErr(__FILE__, __LINE__, "setWallTimeLimit failed", 0, 0);
+    freeMonitorPayload(mp, 1);
+    *pl = NULL;
     return -1;
   }
-  if (addToTasksFile(cg_locs -> pids, pid) == -1) {
-    printErr(__FILE__, __LINE__, "addToTasksFile failed", 0, 0);
+
+  TerminatePayload *tp = malloc(sizeof(TerminatePayload));
+  tp -> dirs = mp -> dirs;
+  tp -> pid = pid;
+  tp -> threads_len = 1;
+  tp -> caller = -1;
+  atomic_init(&(tp -> terminated), 0);
+  atomic_init(&(tp -> done), 0);
+  atomic_init(&(tp -> once), 0);
+  tp -> threads = malloc(sizeof(pthread_t) * (tp -> threads_len));
+  mp -> tp = tp;
+  *pl = tp;
+
+  if (pthread_create(&(tp -> threads[0]), NULL, monitor, mp) != 0) {
+    printErr(__FILE__, __LINE__, "pthread_create failed", 0, 0);
+    freeMonitorPayload(mp, 1);
+    free(tp -> threads);
+    free(tp);
+    *pl = NULL;
     return -1;
   }
   return 0;
-}
\ No newline at end of file
+}
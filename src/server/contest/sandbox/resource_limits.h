@@ -9,11 +9,19 @@
 #define MEM_LIM_EXCEED 1
 #define TIME_LIM_EXCEED 2
 #define TASK_LIM_EXCEED 3
+#define WALL_LIM_EXCEED 4
 
 typedef struct ResLimits {
   const char *cpu_time; // nanoseconds
   const char *mem; // bytes
   const char *num_tasks; // max number of pids allotted
+  // max size in bytes of any file the executable writes, its stdout
+  // included; NULL for no limit. Unlike the limits above it is an rlimit
+  // (RLIMIT_FSIZE) set in the child, since cgroups do not count bytes written
+  const char *output;
+  // nanoseconds the executable may exist for, whether it runs, sleeps or
+  // blocks; NULL for no limit. Bounds how long a run can hold a slot.
+  const char *wall_time;
 } ResLimits;
 
 typedef struct CgroupLocs {
@@ -29,14 +37,68 @@ typedef struct CgroupLocs {
   // mount option specifying a 'pids' controller. One directory per
   // sandboxed executable will be created in this cgroup.
   const char *pids;
+  // Location to a cgroup(directory) in a file system of type 'cgroup' with
+  // mount option specifying a 'cpuset' controller, or NULL. Only used by the
+  // sandbox server, which creates one directory per slot in it to pin the
+  // slot to its CPU.
+  const char *cpuset;
+  // Location to a cgroup(directory) in a file system of type 'cgroup2', or
+  // NULL. When set, the fields above are ignored and a single directory per
+  // sandboxed executable is created here, with the 'memory', 'pids' and
+  // 'cpu' controllers enabled in its 'cgroup.subtree_control'.
+  const char *unified;
+
+  // Number of pre-made 'pool<n>' directories, configured once and reused by
+  // run after run (counters are reset instead of the directories being
+  // removed and created again). 0 disables the pool.
+  int pool_size;
+  // How many directories to add when every pool directory is in use; with 0
+  // such a run gets directories of its own, created and removed as without
+  // a pool
+  int pool_refill;
 
   // Directory paths should not have trailing forward slash
 } CgroupLocs;
 
 typedef struct TerminatePayload TerminatePayload;
 
+/*
+  Returns 1 if |dir| is in a cgroup2 (unified hierarchy) file system, else 0
+*/
+int isUnifiedHierarchy(const char *dir);
+
 int setResourceLimits(
   pid_t pid, const ResLimits *res_limits, const CgroupLocs *cg_locs,
   int *exceeded, TerminatePayload **pl);
 
-#endif
\ No newline at end of file
+/*
+  To be used after the sandboxed executable exited and before 'terminate'.
+  Under cgroup v2 the kernel OOM-kills the executable itself, which may be
+  reaped before the monitor sees 'memory.events' change.
+
+  Returns:
+    MEM_LIM_EXCEED if the run was OOM killed, else NO_EXCEED
+*/
+int checkMemExceeded(const TerminatePayload *tp);
+
+/*
+  What the sandboxed executable used, as counted by its cgroups. -1 for any
+  value that is not known.
+*/
+typedef struct RunUsage {
+  long long cpu_time; // nanoseconds
+  long long peak_mem; // bytes
+  long long peak_tasks; // processes and threads at the same time
+} RunUsage;
+
+/*
+  To be used like 'checkMemExceeded', before the cgroup directories of the
+  run are released.
+
+  Returns:
+    0 on success
+    -1 if the cpu time could not be read
+*/
+int readRunUsage(const TerminatePayload *tp, RunUsage *usage);
+
+#endif
@@ -9,135 +9,478 @@
 #include <signal.h> // SIGCHLD
 #include <sys/wait.h> // waitpid()
 #include <sys/types.h> // pid_t, open(), waitpid()
-#include <sys/stat.h> // open()
+#include <sys/stat.h> // open(), stat()
+#include <sys/resource.h> // setrlimit(), getrlimit(), struct rusage
 #include <sys/eventfd.h> // eventfd()
+#include <sys/socket.h> // socketpair(), sendmsg(), recvmsg()
+#include <string.h> // memcpy()
 #include <stdint.h>
-#include <seccomp.h>
+#include <time.h> // clock_gettime()
+#include <sys/syscall.h> // SYS_close_range
+#include <linux/close_range.h> // CLOSE_RANGE_CLOEXEC
 
 #include "logger.h"
 #include "syscall_manager.h"
 #include "sandbox.h"
 #include "resource_limits.h"
 #include "terminate.h"
+#include "input_cache.h"
+#include "profiles.h"
 
 #define EXIT_CHILD_FAILURE 1
-#define SB_VERBOSE
 
-typedef struct ChildPayload {
+// State shared by all the runs of a batch; set up once per batch by
+// 'openSession'
+typedef struct SandboxSession {
   const char *exect_path;
-  const char *jail_path;
+  int jail_fd;
+  const CgroupLocs *cg_locs;
+  const ResLimits *res_lims;
+  const SysCallList *scl; // 'own_scl', or the list of a profile
+  SysCallList own_scl; // read from the whitelist file, if any
+  uid_t uid;
+  gid_t gid;
+  char *child_stack;
+  long int child_stack_size;
+  int warm; // 1 to keep a child parked for the next 'runCase'
+  pid_t warm_pid; // the parked child, -1 if there is none
+  int warm_sock; // parent's end of the socket the parked child waits on
+  int warm_fail; // read end of the failure pipe of the parked child
+} SandboxSession;
+
+typedef struct ChildPayload {
+  const SandboxSession *s;
   const char *input_file;
+  int input_fd; // from the input cache, -1 to open 'input_file'
   const char *output_file;
-  const char *whitelist;
-  scmp_filter_ctx *ctx;
   int notify_c;
   int notify_p;
-  uid_t uid;
-  gid_t gid;
+  int fail_fd; // see 'childFailed'
 } ChildPayload;
 
-static int childFunc(void *arg) {
+/*
+  Tells the parent that the child failed before it could exec the
+  executable, by writing a byte to |fail_fd|, the write end of a pipe with
+  both ends close-on-exec. The executable can not write there, whereas its
+  exit status may be anything, EXIT_CHILD_FAILURE included; 'runCase' tells
+  the two apart with 'childSetupFailed'.
 
-  ChildPayload *cp = (ChildPayload *)arg;
-  int in = open(cp -> input_file, O_RDONLY);
-  if (in == -1) {
-    printErr(__FILE__, __LINE__, "open failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+  Returns:
+    EXIT_CHILD_FAILURE
+*/
+static int childFailed(int fail_fd) {
+
+  char byte = 1;
+  if (write(fail_fd, &byte, 1) == -1) {
+    printErr(__FILE__, __LINE__, "write failed", 1, errno);
   }
-  int out = open(cp -> output_file, O_WRONLY | O_CREAT | O_TRUNC);
-  if (out == -1) {
-    printErr(__FILE__, __LINE__, "open failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+  return EXIT_CHILD_FAILURE;
+}
+
+/*
+  Opens the failure pipe of a child, see 'childFailed'. Both ends are
+  non-blocking: children of other sessions of the process (other threads)
+  may hold copies of the write end until they exec, so the parent must not
+  wait for EOF.
+
+  Returns:
+    0 on success
+    -1 on failure
+
+  Resource residue (when return value == 0):
+    both ends of |fds|
+*/
+static int openFailPipe(int fds[2]) {
+
+  if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) == -1) {
+    printErr(__FILE__, __LINE__, "pipe2 failed", 1, errno);
+    return -1;
   }
-  // Redirect stdio of child process
+  return 0;
+}
+
+/*
+  Closes |fail_fd|, the read end of the failure pipe of a child that was
+  reaped.
+
+  Returns:
+    1 if the child failed before exec (see 'childFailed')
+    0 else
+*/
+static int childSetupFailed(int fail_fd) {
+
+  char byte;
+  ssize_t n;
+  do {
+    n = read(fail_fd, &byte, 1);
+  } while (n == -1 && errno == EINTR);
+  close(fail_fd);
+  return n == 1;
+}
+
+/*
+  Makes |in| and |out| the child's stdin and stdout; closes both.
+
+  Returns:
+    0 on success
+    -1 on failure
+*/
+static int redirectStdio(int in, int out) {
+
   if (dup2(in, STDIN_FILENO) == -1) {
     printErr(__FILE__, __LINE__, "dup2 failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+    return -1;
   }
   if (dup2(out, STDOUT_FILENO) == -1) {
     printErr(__FILE__, __LINE__, "dup2 failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+    return -1;
   }
   if (close(in) == -1) {
     printErr(__FILE__, __LINE__, "close failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+    return -1;
   }
   if (close(out) == -1) {
     printErr(__FILE__, __LINE__, "close failed", 1, errno);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+  'chdir', 'chroot' and drop privileges, in the child.
+
+  Returns:
+    0 on success
+    -1 on failure
+*/
+static int enterJail(const SandboxSession *s) {
+
+  if (fchdir(s -> jail_fd) == -1) {
+    printErr(__FILE__, __LINE__, "fchdir failed", 1, errno);
+    return -1;
+  }
+  if (chroot("./") == -1) {
+    printErr(__FILE__, __LINE__, "chroot failed", 1, errno);
+    return -1;
+  }
+  // a directory fd from outside the jail must not survive the 'chroot'
+  if (close(s -> jail_fd) == -1) {
+    printErr(__FILE__, __LINE__, "close failed", 1, errno);
+    return -1;
+  }
+  // uid and gid persist even after exec and child processes inherit these
+  // from the parent process. Hence all the processes of the executable will
+  // have this uid and gid
+  // First gid must be set and only then uid
+  if (setgid(s -> gid) == -1) {
+    printErr(__FILE__, __LINE__, "setgid failed", 1, errno);
+    return -1;
+  }
+  if (setuid(s -> uid) == -1) {
+    printErr(__FILE__, __LINE__, "setuid failed", 1, errno);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+  Marks every descriptor above stderr close-on-exec, so that whatever the
+  process that started the sandbox holds open (the judge worker's database
+  socket, for one) never reaches the program. Without 'close_range' (before
+  Linux 5.11) every descriptor up to RLIMIT_NOFILE is marked in turn; the jail
+  has no /proc/self/fd to list them.
+*/
+static void cloexecInherited(void) {
+#ifdef SYS_close_range
+  if (syscall(SYS_close_range, 3U, ~0U, CLOSE_RANGE_CLOEXEC) == 0) {
+    return;
+  }
+#endif
+  struct rlimit rl;
+  int max_fd = 1024;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+    max_fd = (int)rl.rlim_cur;
+  }
+  for (int fd = 3; fd < max_fd; fd++) {
+    int flags = fcntl(fd, F_GETFD);
+    if (flags != -1 && !(flags & FD_CLOEXEC)) {
+      fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+    }
+  }
+}
+
+/*
+  The last steps of the child, once in the jail with stdio in place: inherited
+  descriptors, output limit, system call filter and 'execl'.
+
+  Returns:
+    EXIT_CHILD_FAILURE (only returns on failure)
+*/
+static int execInJail(const SandboxSession *s) {
+
+  cloexecInherited();
+
+  // Set last, as the setup before writes no files. One byte over the limit is
+  // allowed so that 'runCase' can tell output of exactly the limit from more.
+  if (s -> res_lims -> output != NULL) {
+    struct rlimit rl;
+    rl.rlim_cur = rl.rlim_max = atoll(s -> res_lims -> output) + 1;
+    if (setrlimit(RLIMIT_FSIZE, &rl) == -1) {
+      printErr(__FILE__, __LINE__, "setrlimit failed", 1, errno);
+      return EXIT_CHILD_FAILURE;
+    }
+  }
+
+  // System calls not in whitelist follow action that was specified in the
+  // call to 'seccomp_init'. The whitelist was already read and resolved by
+  // the parent in 'openSession'.
+  if (installSysCallBlocker(s -> scl) == -1) {
     return EXIT_CHILD_FAILURE;
   }
 
+  if (execl(s -> exect_path, s -> exect_path, (char *)NULL) == -1) {
+    printErr(__FILE__, __LINE__, "execl failed", 1, errno);
+  }
+  return EXIT_CHILD_FAILURE;
+}
+
+static int childFunc(void *arg) {
+
+  ChildPayload *cp = (ChildPayload *)arg;
+  const SandboxSession *s = cp -> s;
+  int in = cp -> input_fd != -1 ?
+    openCachedInput(cp -> input_fd) : open(cp -> input_file, O_RDONLY);
+  if (in == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+    return childFailed(cp -> fail_fd);
+  }
+  int out = open(cp -> output_file, O_WRONLY | O_CREAT | O_TRUNC,
+    S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (out == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+    return childFailed(cp -> fail_fd);
+  }
+  // Redirect stdio of child process
+  if (redirectStdio(in, out) == -1) {
+    return childFailed(cp -> fail_fd);
+  }
+
   // Notify parent to set resource limits and start accounting time, set
   // memory limits etc.
   uint64_t u = 1;
   // Notifies parent which then sets resource limits
   if (write(cp -> notify_p, &u, sizeof(uint64_t)) == -1) {
     printErr(__FILE__, __LINE__, "write failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+    return childFailed(cp -> fail_fd);
   }
   // blocks until resource limits are set in the parent and the parent
   // notifies
   if (read(cp -> notify_c, &u, sizeof(uint64_t)) == -1) {
     printErr(__FILE__, __LINE__, "read failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+    return childFailed(cp -> fail_fd);
   }
   if (close(cp -> notify_c) == -1) {
     printErr(__FILE__, __LINE__, "close failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+    return childFailed(cp -> fail_fd);
   }
   if (close(cp -> notify_p) == -1) {
     printErr(__FILE__, __LINE__, "close failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+    return childFailed(cp -> fail_fd);
   }
 
-  // This is required because call to 'installSysCallBlocker' is made after
-  // 'chroot' and the former requires to access contents of 'whitelist'
-  // O_CLOEXEC is not really necessary since we're trying to close in
-  // anyway in 'installSysCallBlocker'
-  int whitelist_fd = open(cp -> whitelist, O_RDONLY | O_CLOEXEC);
-  if (whitelist_fd == -1) {
-    printErr(__FILE__, __LINE__, "open failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+  if (enterJail(s) == -1) {
+    return childFailed(cp -> fail_fd);
   }
+  execInJail(s);
+  return childFailed(cp -> fail_fd);
+}
 
-  // 'chdir', 'chroot' and drop privileges
-  if (chdir(cp -> jail_path) == -1) {
-    printErr(__FILE__, __LINE__, "chdir failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+// ---- warm child - begin ----
+// A warm child is cloned, jailed and stripped of its privileges ahead of its
+// run and then sleeps in 'recvStdio'. Its run hands it stdin and stdout over
+// a socket (SCM_RIGHTS) once the resource limits are in place, which is all
+// that is left on the critical path.
+
+typedef struct WarmPayload {
+  const SandboxSession *s;
+  int sock; // child's end
+  int parent_sock; // inherited, closed first so that EOF reaches the child
+  int fail_fd; // see 'childFailed'
+} WarmPayload;
+
+/*
+  Sends |in| and |out| over |sock| in a single message.
+
+  Returns:
+    0 on success
+    -1 on failure
+*/
+static int sendStdio(int sock, int in, int out) {
+
+  char byte = 0;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  union {
+    char buf[CMSG_SPACE(2 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+  c -> cmsg_level = SOL_SOCKET;
+  c -> cmsg_type = SCM_RIGHTS;
+  c -> cmsg_len = CMSG_LEN(2 * sizeof(int));
+  int fds[2] = {in, out};
+  memcpy(CMSG_DATA(c), fds, sizeof(fds));
+  if (sendmsg(sock, &msg, MSG_NOSIGNAL) != 1) {
+    printErr(__FILE__, __LINE__, "sendmsg failed", 1, errno);
+    return -1;
   }
-  if (chroot("./") == -1) {
-    printErr(__FILE__, __LINE__, "chroot failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+  return 0;
+}
+
+/*
+  Blocks until 'sendStdio' on the other end of |sock|.
+
+  Returns:
+    0 on success, with '*in' and '*out' set
+    -1 on failure, or if the other end was closed without sending
+*/
+static int recvStdio(int sock, int *in, int *out) {
+
+  char byte;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  union {
+    char buf[CMSG_SPACE(2 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  ssize_t n;
+  do {
+    n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  } while (n == -1 && errno == EINTR);
+  if (n != 1) {
+    // EOF is the parent closing the session
+    return -1;
   }
-  // uid and gid persist even after exec and child processes inherit these
-  // from the parent process. Hence all the processes of the executable will
-  // have this uid and gid
-  // First gid must be set and only then uid
-  if (setgid(cp -> gid) == -1) {
-    printErr(__FILE__, __LINE__, "setgid failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+  struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+  if (c == NULL || c -> cmsg_level != SOL_SOCKET ||
+    c -> cmsg_type != SCM_RIGHTS ||
+    c -> cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+    printErr(__FILE__, __LINE__, "unexpected message", 0, 0);
+    return -1;
   }
-  if (setuid(cp -> uid) == -1) {
-    printErr(__FILE__, __LINE__, "setuid failed", 1, errno);
-    return EXIT_CHILD_FAILURE;
+  int fds[2];
+  memcpy(fds, CMSG_DATA(c), sizeof(fds));
+  *in = fds[0];
+  *out = fds[1];
+  return 0;
+}
+
+static int warmChildFunc(void *arg) {
+
+  WarmPayload *wp = (WarmPayload *)arg;
+  const SandboxSession *s = wp -> s;
+  if (close(wp -> parent_sock) == -1) {
+    printErr(__FILE__, __LINE__, "close failed", 1, errno);
+    return childFailed(wp -> fail_fd);
+  }
+  if (enterJail(s) == -1) {
+    return childFailed(wp -> fail_fd);
+  }
+  int in, out;
+  if (recvStdio(wp -> sock, &in, &out) == -1) {
+    return childFailed(wp -> fail_fd);
   }
+  // 'sock' itself is close-on-exec
+  if (redirectStdio(in, out) == -1) {
+    return childFailed(wp -> fail_fd);
+  }
+  execInJail(s);
+  return childFailed(wp -> fail_fd);
+}
 
-  // System calls not in whitelist follow action that was specified in the
-  // call to 'seccomp_init'
-  if (installSysCallBlocker(cp -> ctx, whitelist_fd) == -1) {
-    return EXIT_CHILD_FAILURE;
+/*
+  Clones a warm child for the next 'runCase' of |s|. A failure only means
+  the next run takes the cold path.
+
+  Returns:
+    0 on success
+    -1 on failure
+
+  Resource residue (when return value == 0):
+    's -> warm_pid', 's -> warm_sock' and 's -> warm_fail'; taken by
+    'runCase' or released by 'dropWarmChild'
+*/
+static int parkWarmChild(SandboxSession *s) {
+
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+    printErr(__FILE__, __LINE__, "socketpair failed", 1, errno);
+    return -1;
+  }
+  int fail[2];
+  if (openFailPipe(fail) == -1) {
+    close(sv[0]);
+    close(sv[1]);
+    return -1;
   }
+  WarmPayload wp;
+  wp.s = s;
+  wp.sock = sv[1];
+  wp.parent_sock = sv[0];
+  wp.fail_fd = fail[1];
+  pid_t pid = clone(
+    warmChildFunc, s -> child_stack + s -> child_stack_size,
+    CLONE_NEWPID | SIGCHLD, &wp);
+  close(sv[1]);
+  close(fail[1]);
+  if (pid == -1) {
+    printErr(__FILE__, __LINE__, "clone failed", 1, errno);
+    close(sv[0]);
+    close(fail[0]);
+    return -1;
+  }
+  s -> warm_pid = pid;
+  s -> warm_sock = sv[0];
+  s -> warm_fail = fail[0];
+  return 0;
+}
 
-  if (execl(cp -> exect_path, cp -> exect_path, (char *)NULL) == -1) {
-    printErr(__FILE__, __LINE__, "execl failed", 1, errno);
+/*
+  Lets the parked child of |s| (if any) exit and reaps it.
+*/
+static void dropWarmChild(SandboxSession *s) {
+
+  if (s -> warm_pid == -1) {
+    return;
   }
-  return EXIT_CHILD_FAILURE;
+  // the child reads EOF and exits by itself
+  close(s -> warm_sock);
+  waitpid(s -> warm_pid, NULL, 0);
+  close(s -> warm_fail);
+  s -> warm_pid = -1;
+  s -> warm_sock = -1;
+  s -> warm_fail = -1;
 }
 
-static int sandboxExecFailCleanup(
-  int notify_p, int notify_c, char *child_stack) {
+// ---- warm child - end ----
+
+static int sandboxExecFailCleanup(int notify_p, int notify_c) {
 
-  free(child_stack);
   int ret = 0;
   if (close(notify_p) == -1) {
     printErr(__FILE__, __LINE__, "close failed", 1, errno);
@@ -151,140 +494,401 @@ static int sandboxExecFailCleanup(
 }
 
 /*
+  Opens the jail, reads the whitelist and allocates the child stack; all of
+  which are reused by every 'runCase' of the session. With a |profile| its
+  system call list is used instead of the file |whitelist|.
+
   Returns:
-    SB_FAILURE
-    SB_RUNTIME_ERR
-    SB_OK
-    SB_MEM_EXCEED
-    SB_TIME_EXCEED
-    SB_TASK_EXCEED
+    0 on success
+    -1 on failure
+
+  Resource residue (when return value == 0):
+    released by 'closeSession'
 */
-int sandboxExec(
-  const char *exect_path, const char *jail_path,
-  const char *input_file, const char *output_file,
+static int openSession(
+  SandboxSession *s, const char *exect_path, const char *jail_path,
   const CgroupLocs *cg_locs, const ResLimits *res_lims,
-  const char *whitelist, uid_t uid, gid_t gid) {
-
-  int notify_p = eventfd(0, 0);
-  int notify_c = eventfd(0, 0);
+  const char *whitelist, const SandboxProfile *profile,
+  uid_t uid, gid_t gid) {
 
-  scmp_filter_ctx ctx;
+  s -> exect_path = exect_path;
+  s -> cg_locs = cg_locs;
+  s -> res_lims = res_lims;
+  s -> uid = uid;
+  s -> gid = gid;
+  s -> warm = 0;
+  s -> warm_pid = -1;
+  s -> warm_sock = -1;
+  s -> warm_fail = -1;
 
-  // ------------------ clone ------------------
+  s -> jail_fd = open(jail_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (s -> jail_fd == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+    return -1;
+  }
+  s -> own_scl.syscalls = NULL;
+  s -> own_scl.prog.filter = NULL;
+  if (profile != NULL) {
+    s -> scl = getProfileSysCallList(profile);
+    if (s -> scl == NULL) {
+      printErr(__FILE__, __LINE__, "getProfileSysCallList failed", 0, 0);
+      close(s -> jail_fd);
+      return -1;
+    }
+  } else {
+    if (loadSysCallList(whitelist, &(s -> own_scl)) == -1) {
+      printErr(__FILE__, __LINE__, "loadSysCallList failed", 0, 0);
+      close(s -> jail_fd);
+      return -1;
+    }
+    s -> scl = &(s -> own_scl);
+  }
   // TODO: what should child_stack_size be set to,
   // considering mem limits will be placed on child proc?
-  long int child_stack_size = 1024 * 1024;
-  char *child_stack = malloc(child_stack_size);
-  if (child_stack == NULL) {
+  s -> child_stack_size = 1024 * 1024;
+  s -> child_stack = malloc(s -> child_stack_size);
+  if (s -> child_stack == NULL) {
     printErr( __FILE__, __LINE__, "malloc failed\n", 0, 0);
-    return SB_FAILURE;
+    freeSysCallList(&(s -> own_scl));
+    close(s -> jail_fd);
+    return -1;
+  }
+  return 0;
+}
+
+static void closeSession(SandboxSession *s) {
+
+  dropWarmChild(s);
+  free(s -> child_stack);
+  freeSysCallList(&(s -> own_scl));
+  if (close(s -> jail_fd) == -1) {
+    printErr(__FILE__, __LINE__, "close failed", 1, errno);
+  }
+}
+
+/*
+  Returns 1 if the run went past the output limit, else 0. The kernel sends
+  SIGXFSZ at the limit; an executable that ignores it only gets short writes,
+  which shows as |output_bytes| being more than the limit.
+*/
+static int outputExceeded(
+  const ResLimits *res_lims, long long output_bytes, int wstatus) {
+
+  if (res_lims -> output == NULL) {
+    return 0;
+  }
+  if (WIFSIGNALED(wstatus) && WTERMSIG(wstatus) == SIGXFSZ) {
+    return 1;
+  }
+  return output_bytes > atoll(res_lims -> output);
+}
+
+static long long elapsedNs(const struct timespec *from) {
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - from -> tv_sec) * 1000000000LL +
+    (now.tv_nsec - from -> tv_nsec);
+}
+
+/*
+  Cpu time of the calling thread since |from|
+*/
+static long long elapsedCpuNs(const struct timespec *from) {
+
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return (now.tv_sec - from -> tv_sec) * 1000000000LL +
+    (now.tv_nsec - from -> tv_nsec);
+}
+
+/*
+  Fills in what is known about the run from |wstatus| and |ru| and from the
+  size of |output_file|.
+*/
+static void fillResult(
+  SandboxResult *res, int wstatus, const struct rusage *ru,
+  const char *output_file) {
+
+  if (WIFEXITED(wstatus)) {
+    res -> exit_code = WEXITSTATUS(wstatus);
+  } else if (WIFSIGNALED(wstatus)) {
+    res -> signal = WTERMSIG(wstatus);
+  }
+  if (res -> peak_mem == -1) {
+    // the largest resident set of a single process; a cgroup peak is not
+    // available for this run
+    res -> peak_mem = (long long)ru -> ru_maxrss * 1024;
+  }
+  struct stat st;
+  if (stat(output_file, &st) == -1) {
+    printErr(__FILE__, __LINE__, "stat failed", 1, errno);
+  } else {
+    res -> output_bytes = st.st_size;
+  }
+}
+
+/*
+  Starts the session's executable with stdin |input_file| and stdout
+  |output_file| in a freshly cloned child. '*exceeded' must outlive the run;
+  '*start' is when the child was let go. The phases go to '*trace', timed
+  from |t0|.
+
+  Returns:
+    0 on success
+    -1 on failure
+
+  Resource residue (when return value == 0):
+    the child '*pid' and '*tp'; released by 'terminateReaped'
+    '*fail_fd', the read end of the child's failure pipe; released by
+    'childSetupFailed'
+*/
+static int launchCold(
+  const SandboxSession *s, const char *input_file, const char *output_file,
+  pid_t *pid, int *exceeded, TerminatePayload **tp, struct timespec *start,
+  SandboxTrace *trace, const struct timespec *t0, int *fail_fd) {
+
+  const CgroupLocs *cg_locs = s -> cg_locs;
+  // close-on-exec: batches may run on several threads of one process, whose
+  // children must not get hold of the handshake of this one
+  int notify_p = eventfd(0, EFD_CLOEXEC);
+  int notify_c = eventfd(0, EFD_CLOEXEC);
+  int fail[2];
+  if (openFailPipe(fail) == -1) {
+    sandboxExecFailCleanup(notify_p, notify_c);
+    return -1;
   }
+
+  // ------------------ clone ------------------
   ChildPayload cp;
-  cp.exect_path = exect_path;
-  cp.jail_path = jail_path;
+  cp.s = s;
   cp.input_file = input_file;
+  cp.input_fd = getCachedInput(input_file);
   cp.output_file = output_file;
-  cp.whitelist = whitelist;
-  cp.ctx = &ctx;
   cp.notify_p = notify_p;
   cp.notify_c = notify_c;
-  cp.uid = uid;
-  cp.gid = gid;
+  cp.fail_fd = fail[1];
 
   // assuming downwardly growing stack
   // this pid is (also) the pid from kernel view
-  pid_t pid = clone(
-    childFunc, child_stack + child_stack_size, CLONE_NEWPID | SIGCHLD,
-    &cp);
-  if (pid == -1) {
+  // Without CLONE_VM the child works on its own copy of the stack, so the
+  // same stack can be handed to every clone of the session
+  *pid = clone(
+    childFunc, s -> child_stack + s -> child_stack_size,
+    CLONE_NEWPID | SIGCHLD, &cp);
+  close(fail[1]);
+  if (*pid == -1) {
     printErr(__FILE__, __LINE__, "clone failed", 1, errno);
-    if (sandboxExecFailCleanup(notify_p, notify_c, child_stack) == -1) {
+    close(fail[0]);
+    if (sandboxExecFailCleanup(notify_p, notify_c) == -1) {
       printErr(
         __FILE__, __LINE__, "sandboxExecFailCleanup failed", 1, errno);
     }
-    return SB_FAILURE;
+    return -1;
   }
+  trace -> clone = elapsedNs(t0);
 
   // ------------------ set resource limits ------------------
   uint64_t u;
   // blocks until child notifies
   if (read(notify_p, &u, sizeof(u)) == -1) {
     printErr(__FILE__, __LINE__, "read failed", 1, errno);
-    if (kill(pid, SIGTERM) == -1) {
+    if (kill(*pid, SIGTERM) == -1) {
       printErr(__FILE__, __LINE__, "kill failed", 1, errno);
     }
-    if (sandboxExecFailCleanup(notify_p, notify_c, child_stack) == -1) {
+    if (sandboxExecFailCleanup(notify_p, notify_c) == -1) {
       printErr(
         __FILE__, __LINE__, "sandboxExecFailCleanup failed", 1, errno);
     }
-    return SB_FAILURE;
+    close(fail[0]);
+    return -1;
   }
-  int exceeded = NO_EXCEED;
-  TerminatePayload *tp;
+  trace -> ready = elapsedNs(t0);
   if (setResourceLimits(
-    pid, res_lims, cg_locs, &exceeded, &tp) == -1) {
+    *pid, s -> res_lims, cg_locs, exceeded, tp) == -1) {
     printErr(__FILE__, __LINE__, "setResourceLimits failed", 0, 0);
 
-    if (kill(pid, SIGTERM) == -1) {
+    if (kill(*pid, SIGTERM) == -1) {
       printErr(__FILE__, __LINE__, "kill failed", 1, errno);
     }
 
-    if (sandboxExecFailCleanup(notify_p, notify_c, child_stack) == -1) {
+    if (sandboxExecFailCleanup(notify_p, notify_c) == -1) {
       printErr(
         __FILE__, __LINE__, "sandboxExecFailCleanup failed", 1, errno);
     }
-    return SB_FAILURE;
+    close(fail[0]);
+    return -1;
   }
+  trace -> limits = elapsedNs(t0);
   u = 1;
+  // wall time counts from the moment the child may go on to 'execl'
+  clock_gettime(CLOCK_MONOTONIC, start);
   // notify child that resource limits are set
   if (write(notify_c, &u, sizeof(u)) == -1) {
     printErr(__FILE__, __LINE__, "write failed", 1, errno);
 
-    if (kill(pid, SIGTERM) == -1) {
+    if (kill(*pid, SIGTERM) == -1) {
       printErr(__FILE__, __LINE__, "kill failed", 1, errno);
     }
 
-    if (removePidDirs(cg_locs, pid) == -1) {
-      printErr(__FILE__, __LINE__, "kill failed", 1, errno);
-    }
+    // the monitor is running already; 'terminate' also releases the cgroup
+    // directories of the run
+    waitpid(*pid, NULL, 0);
+    terminateReaped(*tp);
 
-    if (sandboxExecFailCleanup(notify_p, notify_c, child_stack) == -1) {
+    if (sandboxExecFailCleanup(notify_p, notify_c) == -1) {
       printErr(
         __FILE__, __LINE__, "sandboxExecFailCleanup failed", 1, errno);
     }
-    return SB_FAILURE;
+    close(fail[0]);
+    return -1;
   }
+  trace -> release = elapsedNs(t0);
   if (close(notify_p) == -1) {
     printErr(__FILE__, __LINE__, "close failed", 1, errno);
   }
   if (close(notify_c) == -1) {
     printErr(__FILE__, __LINE__, "close failed", 1, errno);
   }
+  *fail_fd = fail[0];
+  return 0;
+}
 
-  // ------------------ wait for child to terminate ------------------
-  int wstatus;
-  waitpid(pid, &wstatus, 0);
+/*
+  Same as 'launchCold', with the parked child of |s| instead of a new one.
+  The parked child is used up either way.
+*/
+static int launchWarm(
+  SandboxSession *s, const char *input_file, const char *output_file,
+  pid_t *pid, int *exceeded, TerminatePayload **tp, struct timespec *start,
+  SandboxTrace *trace, const struct timespec *t0, int *fail_fd) {
 
-  tp -> terminated = 1;
+  *pid = s -> warm_pid;
+  int sock = s -> warm_sock;
+  int fail = s -> warm_fail;
+  s -> warm_pid = -1;
+  s -> warm_sock = -1;
+  s -> warm_fail = -1;
+  trace -> clone = trace -> ready = 0;
 
-  // free resources
-  free(child_stack);
-  if (ctx != NULL) {
-    seccomp_release(ctx);
+  int cached = getCachedInput(input_file);
+  int in = cached != -1 ?
+    openCachedInput(cached) : open(input_file, O_RDONLY | O_CLOEXEC);
+  int out = in == -1 ? -1 :
+    open(output_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (in == -1 || out == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+    if (in != -1) {
+      close(in);
+    }
+    close(sock);
+    waitpid(*pid, NULL, 0);
+    close(fail);
+    return -1;
   }
+  if (setResourceLimits(
+    *pid, s -> res_lims, s -> cg_locs, exceeded, tp) == -1) {
+    printErr(__FILE__, __LINE__, "setResourceLimits failed", 0, 0);
+    close(in);
+    close(out);
+    close(sock);
+    waitpid(*pid, NULL, 0);
+    close(fail);
+    return -1;
+  }
+  trace -> limits = elapsedNs(t0);
+  clock_gettime(CLOCK_MONOTONIC, start);
+  int ret = sendStdio(sock, in, out);
+  close(in);
+  close(out);
+  close(sock);
+  if (ret == -1) {
+    printErr(__FILE__, __LINE__, "sendStdio failed", 0, 0);
+    // the monitor is running already
+    waitpid(*pid, NULL, 0);
+    terminateReaped(*tp);
+    close(fail);
+    return -1;
+  }
+  trace -> release = elapsedNs(t0);
+  *fail_fd = fail;
+  return 0;
+}
 
-  if (tp -> once == 1) {
-    // reaching here means 'terminate' was called, hence wait for it to
-    // finish
-    while (tp -> done == 0);
-  } else {
-    // need to cancel the threads
-    tp -> skip = NULL;
-    if (terminate(tp) == -1) {
-      printErr(__FILE__, __LINE__, "terminate failed", 0, 0);
-    }
+/*
+  Runs the session's executable once with stdin |input_file| and stdout
+  |output_file|. Whatever can be measured of the run goes to '*res', apart
+  from 'res -> verdict', which the caller sets to the return value. With
+  |more| set (another 'runCase' follows) and 's -> warm', the child of the
+  next run is parked while this one runs.
+
+  Returns:
+    SB_FAILURE
+    SB_RUNTIME_ERR
+    SB_OK
+    SB_MEM_EXCEED
+    SB_TIME_EXCEED
+    SB_TASK_EXCEED
+    SB_OUTPUT_EXCEED
+    SB_WALL_TIME_EXCEED
+*/
+static int runCase(
+  SandboxSession *s, const char *input_file, const char *output_file,
+  int more, SandboxResult *res) {
+
+  failedSandboxResult(res);
+  struct timespec t0, cpu0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu0);
+  SandboxTrace *trace = &(res -> trace);
+
+  pid_t pid;
+  int exceeded = NO_EXCEED;
+  TerminatePayload *tp;
+  struct timespec start;
+  int fail_fd;
+  int launched = s -> warm_pid != -1 ?
+    launchWarm(
+      s, input_file, output_file, &pid, &exceeded, &tp, &start, trace, &t0,
+      &fail_fd) :
+    launchCold(
+      s, input_file, output_file, &pid, &exceeded, &tp, &start, trace, &t0,
+      &fail_fd);
+  if (launched == -1) {
+    return SB_FAILURE;
+  }
+  // the clone and the jail setup of the next child overlap with this run,
+  // outside of its cgroups
+  if (more && s -> warm && parkWarmChild(s) == -1) {
+    printErr(__FILE__, __LINE__, "parkWarmChild failed", 0, 0);
+  }
+
+  // ------------------ wait for child to terminate ------------------
+  int wstatus;
+  struct rusage ru;
+  wait4(pid, &wstatus, 0, &ru);
+  res -> wall_time = elapsedNs(&start);
+  trace -> exit = elapsedNs(&t0);
+  // written before the child exited, if at all
+  int setup_failed = childSetupFailed(fail_fd);
+
+  // read before 'terminateReaped', since from then on 'terminate' may
+  // release the cgroup directories of the run
+  int oom = checkMemExceeded(tp);
+  RunUsage usage;
+  if (readRunUsage(tp, &usage) == 0) {
+    res -> cpu_time = usage.cpu_time;
+  }
+  res -> peak_mem = usage.peak_mem;
+  res -> peak_tasks = usage.peak_tasks;
+  long long monitor_cpu = terminateReaped(tp);
+  trace -> cleanup = elapsedNs(&t0);
+  trace -> judge_cpu = elapsedCpuNs(&cpu0) + monitor_cpu;
+  fillResult(res, wstatus, &ru, output_file);
+  if (exceeded == NO_EXCEED) {
+    exceeded = oom;
   }
-  free(tp);
 
   #ifdef SB_VERBOSE
   printf("**************** Results *********************\n");
@@ -294,7 +898,7 @@ int sandboxExec(
     #ifdef SB_VERBOSE
     printf("Child exited with exit status: %d\n", WEXITSTATUS(wstatus));
     #endif
-    if (WEXITSTATUS(wstatus) == EXIT_CHILD_FAILURE) {
+    if (setup_failed) {
       printErr(__FILE__, __LINE__, "Sandbox failure", 0, 0);
       return SB_FAILURE;
     }
@@ -308,6 +912,14 @@ int sandboxExec(
     return SB_FAILURE;
   }
 
+  if (exceeded == NO_EXCEED &&
+    outputExceeded(s -> res_lims, res -> output_bytes, wstatus)) {
+    #ifdef SB_VERBOSE
+    printf("Output limit exceeded\n");
+    #endif
+    return SB_OUTPUT_EXCEED;
+  }
+
   switch(exceeded) {
     case NO_EXCEED:
       if (WIFSIGNALED(wstatus)) {
@@ -339,8 +951,165 @@ int sandboxExec(
       printf("Task limit exceeded\n");
       #endif
       return SB_TASK_EXCEED;
+    case WALL_LIM_EXCEED:
+      #ifdef SB_VERBOSE
+      printf("Wall time limit exceeded\n");
+      #endif
+      return SB_WALL_TIME_EXCEED;
     default:
       printErr(__FILE__, __LINE__, "Unexpected value for exceeded", 0, 0);
       return SB_FAILURE;
   }
 }
+
+/*
+  Returns:
+    SB_FAILURE
+    SB_RUNTIME_ERR
+    SB_OK
+    SB_MEM_EXCEED
+    SB_TIME_EXCEED
+    SB_TASK_EXCEED
+    SB_OUTPUT_EXCEED
+    SB_WALL_TIME_EXCEED
+
+  '*result' (if not NULL) receives the verdict along with what the run used.
+*/
+int sandboxExec(
+  const char *exect_path, const char *jail_path,
+  const char *input_file, const char *output_file,
+  const CgroupLocs *cg_locs, const ResLimits *res_lims,
+  const char *whitelist, uid_t uid, gid_t gid, SandboxResult *result) {
+
+  SandboxSession s;
+  SandboxResult res;
+  if (openSession(
+    &s, exect_path, jail_path, cg_locs, res_lims, whitelist, NULL,
+    uid, gid) == -1) {
+    printErr(__FILE__, __LINE__, "openSession failed", 0, 0);
+    if (result != NULL) {
+      failedSandboxResult(result);
+    }
+    return SB_FAILURE;
+  }
+  res.verdict = runCase(&s, input_file, output_file, 0, &res);
+  closeSession(&s);
+  if (result != NULL) {
+    *result = res;
+  }
+  return res.verdict;
+}
+
+/*
+  One session for all of |cases|, under the file |whitelist| or, if not NULL,
+  the system calls of |profile|; see 'sandboxExecBatch'.
+
+  Returns:
+    as 'sandboxExecBatch'
+*/
+static int runBatch(
+  const char *exect_path, const char *jail_path,
+  const SandboxCase *cases, int cases_len,
+  const CgroupLocs *cg_locs, const ResLimits *res_lims,
+  const char *whitelist, const SandboxProfile *profile,
+  uid_t uid, gid_t gid, SandboxResult *results,
+  SandboxCaseDone done, void *done_arg) {
+
+  SandboxSession s;
+  if (openSession(
+    &s, exect_path, jail_path, cg_locs, res_lims, whitelist, profile,
+    uid, gid) == -1) {
+    printErr(__FILE__, __LINE__, "openSession failed", 0, 0);
+    return SB_FAILURE;
+  }
+  s.warm = 1;
+  int i;
+  for (i = 0; i < cases_len; i++) {
+    results[i].verdict = runCase(
+      &s, cases[i].input_file, cases[i].output_file, i + 1 < cases_len,
+      &(results[i]));
+    if (done != NULL) {
+      done(i, &(results[i]), done_arg);
+    }
+  }
+  closeSession(&s);
+  return SB_OK;
+}
+
+/*
+  Runs |exect_path| once for every element of |cases|, back to back, while
+  the jail, the whitelist and the child stack are set up only once. The
+  child of each case after the first is cloned and jailed while the case
+  before it runs.
+  results[i] receives what 'sandboxExec' would have for cases[i], and
+  |done| (if not NULL) is called with it right after the case.
+
+  Returns:
+    SB_OK when every case was run (individual failures are in |results|)
+    SB_FAILURE when the batch could not be set up; |results| is untouched
+*/
+int sandboxExecBatch(
+  const char *exect_path, const char *jail_path,
+  const SandboxCase *cases, int cases_len,
+  const CgroupLocs *cg_locs, const ResLimits *res_lims,
+  const char *whitelist, uid_t uid, gid_t gid, SandboxResult *results,
+  SandboxCaseDone done, void *done_arg) {
+
+  return runBatch(
+    exect_path, jail_path, cases, cases_len, cg_locs, res_lims, whitelist,
+    NULL, uid, gid, results, done, done_arg);
+}
+
+/*
+  Same as 'sandboxExecBatch', with the system calls of the profile |profile|
+  (see 'profiles.h') instead of a whitelist file. Fields of |res_lims| given
+  as "-" take the profile's defaults.
+
+  Returns:
+    as 'sandboxExecBatch'; SB_FAILURE too if there is no such profile
+*/
+int sandboxExecBatchProfile(
+  const char *exect_path, const char *jail_path,
+  const SandboxCase *cases, int cases_len,
+  const CgroupLocs *cg_locs, const ResLimits *res_lims,
+  const char *profile, uid_t uid, gid_t gid, SandboxResult *results,
+  SandboxCaseDone done, void *done_arg) {
+
+  const SandboxProfile *p = findProfile(profile);
+  if (p == NULL) {
+    printErr(__FILE__, __LINE__, "unknown profile", 0, 0);
+    return SB_FAILURE;
+  }
+  ResLimits lims = *res_lims;
+  applyProfileLimits(p, &lims);
+
+  return runBatch(
+    exect_path, jail_path, cases, cases_len, cg_locs, &lims, NULL, p,
+    uid, gid, results, done, done_arg);
+}
+
+void failedSandboxResult(SandboxResult *result) {
+
+  result -> verdict = SB_FAILURE;
+  result -> cpu_time = result -> wall_time = -1;
+  result -> peak_mem = result -> peak_tasks = -1;
+  result -> exit_code = -1;
+  result -> signal = 0;
+  result -> output_bytes = -1;
+  SandboxTrace *t = &(result -> trace);
+  t -> clone = t -> ready = t -> limits = t -> release = -1;
+  t -> exit = t -> cleanup = t -> judge_cpu = -1;
+}
+
+int formatSandboxResult(const SandboxResult *result, char *buf, size_t len) {
+
+  const SandboxTrace *t = &(result -> trace);
+  return snprintf(buf, len,
+    "%d\t%lld\t%lld\t%lld\t%lld\t%d\t%d\t%lld"
+    "\t%lld\t%lld\t%lld\t%lld\t%lld\t%lld\t%lld",
+    result -> verdict, result -> cpu_time, result -> wall_time,
+    result -> peak_mem, result -> peak_tasks, result -> exit_code,
+    result -> signal, result -> output_bytes,
+    t -> clone, t -> ready, t -> limits, t -> release, t -> exit,
+    t -> cleanup, t -> judge_cpu);
+}
@@ -1,6 +1,7 @@
 #ifndef SANDBOX_H_
 #define SANDBOX_H_
 
+#include <stddef.h> // size_t
 #include <sys/types.h>
 
 // So that including 'sandbox.h' in user application is enough for using
@@ -14,14 +15,101 @@
 #define SB_MEM_EXCEED 3
 #define SB_TIME_EXCEED 4
 #define SB_TASK_EXCEED 5
+#define SB_OUTPUT_EXCEED 6
+#define SB_WALL_TIME_EXCEED 7
+
+/*
+  When the phases of a run ended, in nanoseconds from the start of the run
+  on CLOCK_MONOTONIC; -1 for the phases it did not get to. A parked child
+  (see 'sandboxExecBatch') was cloned and ready before the run started, at 0.
+*/
+typedef struct SandboxTrace {
+  long long clone; // child cloned
+  long long ready; // child has its stdio and waits for its limits
+  long long limits; // cgroups set up and monitor started
+  long long release; // child let go on to 'execl'
+  long long exit; // executable reaped
+  long long cleanup; // monitor stopped and cgroups released
+  // not a timestamp: cpu time the sandbox spent on the run, in the calling
+  // thread and the monitor thread(s)
+  long long judge_cpu;
+} SandboxTrace;
+
+// Room for the line of 'formatSandboxResult'
+#define SB_RESULT_LEN 512
+
+/*
+  The outcome of one run. Every value that could not be measured is -1.
+*/
+typedef struct SandboxResult {
+  int verdict; // one of SB_*
+  long long cpu_time; // nanoseconds, from the cpu cgroup
+  long long wall_time; // nanoseconds, from the start of the executable until
+                       // it was reaped
+  long long peak_mem; // bytes; the cgroup's peak usage where the kernel keeps
+                      // one per run, else the peak resident set
+  long long peak_tasks; // most processes and threads alive at once
+  int exit_code; // -1 if killed by a signal
+  int signal; // the signal that killed the executable, 0 if it exited
+  long long output_bytes; // size of the output file
+  SandboxTrace trace;
+} SandboxResult;
+
+typedef struct SandboxCase {
+  const char *input_file;
+  const char *output_file;
+} SandboxCase;
+
+/*
+  Called by 'sandboxExecBatch' as soon as cases[|index|] has run, so that its
+  output can be dealt with before the rest of the batch is done. |arg| is
+  the 'done_arg' of the batch.
+*/
+typedef void (*SandboxCaseDone)(
+  int index, const SandboxResult *result, void *arg);
 
 int sandboxExec(
   const char *exect_path, const char *jail_path,
   const char *input_file, const char *output_file,
   const CgroupLocs *cg_locs, const ResLimits *res_lims,
-  const char *whitelist, uid_t uid, gid_t gid);
+  const char *whitelist, uid_t uid, gid_t gid, SandboxResult *result);
+
 
-#endif
 /*
   sudo ./a.out "1M" "1000000000" "1" "/sys/fs/cgroup/memory/test" "/sys/fs/cgroup/cpuacct/test" "/sys/fs/cgroup/pids/test" "temp/jail" "exect" "temp/in" "temp/out" "temp/wl" "1000" "1000"
-*/
\ No newline at end of file
+*/
+
+int sandboxExecBatch(
+  const char *exect_path, const char *jail_path,
+  const SandboxCase *cases, int cases_len,
+  const CgroupLocs *cg_locs, const ResLimits *res_lims,
+  const char *whitelist, uid_t uid, gid_t gid, SandboxResult *results,
+  SandboxCaseDone done, void *done_arg);
+
+/*
+  |profile| names one of the language profiles of 'profiles.c', e.g. "c" or
+  "cpp".
+*/
+int sandboxExecBatchProfile(
+  const char *exect_path, const char *jail_path,
+  const SandboxCase *cases, int cases_len,
+  const CgroupLocs *cg_locs, const ResLimits *res_lims,
+  const char *profile, uid_t uid, gid_t gid, SandboxResult *results,
+  SandboxCaseDone done, void *done_arg);
+
+/*
+  Sets '*result' to SB_FAILURE with nothing measured
+*/
+void failedSandboxResult(SandboxResult *result);
+
+/*
+  Writes '*result' to |buf| as one line without the new line: the fields of
+  'SandboxResult' in their order, those of 'trace' last, separated by '\t'.
+  This is what 'sandbox-exe' prints and what the server sends back per job.
+
+  Returns:
+    as 'snprintf'
+*/
+int formatSandboxResult(const SandboxResult *result, char *buf, size_t len);
+
+#endif
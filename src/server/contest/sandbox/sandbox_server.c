@@ -0,0 +1,562 @@
+#define _GNU_SOURCE // for accept4(), sched_setaffinity(); has to be before
+                    // the #includes
+
+#include <stdio.h>
+#include <stdlib.h> // malloc(), realloc()
+#include <string.h> // strsep(), strlen()
+#include <errno.h>
+#include <signal.h> // signal(), SIGPIPE
+#include <unistd.h> // close(), unlink(), fork()
+#include <fcntl.h> // fcntl(), open()
+#include <sched.h> // sched_setaffinity()
+#include <sys/types.h>
+#include <sys/stat.h> // chmod(), mkdir()
+#include <sys/wait.h> // wait()
+#include <sys/socket.h> // socket(), bind(), listen(), accept()
+#include <sys/un.h> // sockaddr_un
+
+#include "logger.h"
+#include "sandbox.h"
+#include "sandbox_server.h"
+#include "input_cache.h"
+
+#define SERVER_BACKLOG 64
+#define HEADER_FIELDS 5
+#define HEADER_MAX_FIELDS 8 // with the optional output limit, profile and
+                            // wall time limit
+#define JOB_FIELDS 2
+// bytes of testcase input each worker keeps in memory, see 'input_cache.h'
+#define SERVER_INPUT_CACHE_SIZE (256LL * 1024 * 1024)
+
+typedef struct ServerBatch {
+  char *header; // backing storage for the fields below
+  const char *exect_path;
+  const char *jail_path;
+  ResLimits res_lims;
+  const char *profile; // NULL to use the server's whitelist
+  SandboxCase *jobs;
+  int jobs_len;
+} ServerBatch;
+
+/*
+  Splits |line| in place on '\t' into at most |max| fields after stripping the
+  trailing new line.
+
+  Returns:
+    number of fields found
+*/
+static int splitFields(char *line, char **fields, int max) {
+
+  size_t len = strlen(line);
+  if (len > 0 && line[len - 1] == '\n') {
+    line[len - 1] = '\0';
+  }
+  int n = 0;
+  char *field;
+  while (n < max && (field = strsep(&line, "\t")) != NULL) {
+    fields[n++] = field;
+  }
+  // more fields than expected is treated as a malformed line
+  if (line != NULL) {
+    return max + 1;
+  }
+  return n;
+}
+
+static void freeBatch(ServerBatch *b) {
+
+  int i;
+  for (i = 0; i < b -> jobs_len; i++) {
+    // 'output_file' shares the allocation of 'input_file'
+    free((char *)b -> jobs[i].input_file);
+  }
+  free(b -> jobs);
+  free(b -> header);
+}
+
+/*
+  Reads one batch from |fp|.
+
+  Returns:
+    0 on success
+    -1 on a malformed request or read error
+
+  Resource residue (when return value == 0):
+    'b -> header' and every 'b -> jobs[i].input_file' malloc, freed by
+    'freeBatch'
+*/
+static int readBatch(FILE *fp, ServerBatch *b) {
+
+  b -> header = NULL;
+  b -> jobs = NULL;
+  b -> jobs_len = 0;
+
+  size_t cap = 0;
+  if (getline(&(b -> header), &cap, fp) == -1) {
+    printErr(__FILE__, __LINE__, "getline failed", 1, errno);
+    free(b -> header);
+    b -> header = NULL;
+    return -1;
+  }
+  char *f[HEADER_MAX_FIELDS + 1];
+  int n = splitFields(b -> header, f, HEADER_MAX_FIELDS);
+  if (n < HEADER_FIELDS || n > HEADER_MAX_FIELDS) {
+    printErr(__FILE__, __LINE__, "malformed batch header", 0, 0);
+    freeBatch(b);
+    return -1;
+  }
+  b -> exect_path = f[0];
+  b -> jail_path = f[1];
+  b -> res_lims.mem = f[2];
+  b -> res_lims.cpu_time = f[3];
+  b -> res_lims.num_tasks = f[4];
+  b -> res_lims.output = n > HEADER_FIELDS ? f[5] : NULL;
+  b -> profile = n > HEADER_FIELDS + 1 && strcmp(f[6], "-") != 0 ?
+    f[6] : NULL;
+  b -> res_lims.wall_time = n > HEADER_FIELDS + 2 ? f[7] : NULL;
+  if (b -> profile == NULL) {
+    // "-" means the default of the profile, which there is none of
+    const char *lims[] = {
+      f[2], f[3], f[4], b -> res_lims.output, b -> res_lims.wall_time};
+    int i;
+    for (i = 0; i < 5; i++) {
+      if (lims[i] != NULL && strcmp(lims[i], "-") == 0) {
+        printErr(__FILE__, __LINE__, "default limit without profile", 0, 0);
+        freeBatch(b);
+        return -1;
+      }
+    }
+  }
+
+  int jobs_cap = 0;
+  while (1) {
+    char *line = NULL;
+    cap = 0;
+    if (getline(&line, &cap, fp) == -1) {
+      printErr(__FILE__, __LINE__, "batch not terminated", 0, 0);
+      free(line);
+      freeBatch(b);
+      return -1;
+    }
+    if (line[0] == '\n') {
+      free(line);
+      return 0;
+    }
+    char *jf[JOB_FIELDS + 1];
+    if (splitFields(line, jf, JOB_FIELDS) != JOB_FIELDS) {
+      printErr(__FILE__, __LINE__, "malformed job line", 0, 0);
+      free(line);
+      freeBatch(b);
+      return -1;
+    }
+    if (b -> jobs_len == jobs_cap) {
+      jobs_cap = jobs_cap == 0 ? 16 : jobs_cap * 2;
+      SandboxCase *jobs = realloc(b -> jobs, sizeof(SandboxCase) * jobs_cap);
+      if (jobs == NULL) {
+        printErr(__FILE__, __LINE__, "realloc failed", 0, 0);
+        free(line);
+        freeBatch(b);
+        return -1;
+      }
+      b -> jobs = jobs;
+    }
+    // jf[0] == line, so freeing 'input_file' frees both fields
+    b -> jobs[b -> jobs_len].input_file = jf[0];
+    b -> jobs[b -> jobs_len].output_file = jf[1];
+    b -> jobs_len++;
+  }
+}
+
+// Where 'sendResult' writes to
+typedef struct ResultSink {
+  int conn;
+  int sent; // results written so far, or -1 once the client went away
+} ResultSink;
+
+/*
+  'SandboxCaseDone' of a connection: the result of each job is written back
+  as soon as it ran, so that the client may take its output away meanwhile.
+*/
+static void sendResult(int index, const SandboxResult *result, void *arg) {
+
+  ResultSink *sink = (ResultSink *)arg;
+  if (sink -> sent == -1) {
+    return;
+  }
+  char line[SB_RESULT_LEN];
+  formatSandboxResult(result, line, sizeof(line));
+  if (dprintf(sink -> conn, "%s\n", line) < 0) {
+    // client went away, there is no one left to report to
+    printErr(__FILE__, __LINE__, "dprintf failed", 1, errno);
+    sink -> sent = -1;
+    return;
+  }
+  sink -> sent = index + 1;
+}
+
+/*
+  Serves a single connection: reads one batch, runs it with
+  'sandboxExecBatch' and writes back one result per job, each as soon as
+  the job ran.
+*/
+static void serveConnection(
+  int conn, const CgroupLocs *cg_locs, const char *whitelist,
+  uid_t uid, gid_t gid) {
+
+  // 'fclose' on 'fp' would close the descriptor it wraps, hence the dup.
+  // Close on exec so that no sandboxed executable inherits the connection.
+  int in = fcntl(conn, F_DUPFD_CLOEXEC, 0);
+  if (in == -1) {
+    printErr(__FILE__, __LINE__, "fcntl failed", 1, errno);
+    return;
+  }
+  FILE *fp = fdopen(in, "r");
+  if (fp == NULL) {
+    printErr(__FILE__, __LINE__, "fdopen failed", 1, errno);
+    close(in);
+    return;
+  }
+
+  ServerBatch b;
+  if (readBatch(fp, &b) == 0) {
+    int i;
+    SandboxResult *results = malloc(sizeof(SandboxResult) * b.jobs_len);
+    if (results == NULL) {
+      printErr(__FILE__, __LINE__, "malloc failed", 0, 0);
+    } else {
+      ResultSink sink = {conn, 0};
+      int ret = b.profile != NULL ?
+        sandboxExecBatchProfile(
+          b.exect_path, b.jail_path, b.jobs, b.jobs_len, cg_locs,
+          &b.res_lims, b.profile, uid, gid, results, sendResult, &sink) :
+        sandboxExecBatch(
+          b.exect_path, b.jail_path, b.jobs, b.jobs_len, cg_locs,
+          &b.res_lims, whitelist, uid, gid, results, sendResult, &sink);
+      if (ret != SB_OK) {
+        // the batch was not set up, so none was sent
+        for (i = 0; i < b.jobs_len; i++) {
+          failedSandboxResult(&(results[i]));
+          sendResult(i, &(results[i]), &sink);
+        }
+      }
+      free(results);
+    }
+    freeBatch(&b);
+  }
+  fflush(stdout);
+
+  if (fclose(fp) != 0) {
+    printErr(__FILE__, __LINE__, "fclose failed", 1, errno);
+  }
+}
+
+/*
+  Creates the directory |cg|/slot|slot| unless it already exists.
+
+  Returns:
+    NULL on error
+    a malloc'd NTCS |cg|/slot|slot| on success
+*/
+static char *createSlotDir(const char *cg, int slot) {
+
+  char *dir = malloc(sizeof(char) * (strlen(cg) + 16));
+  if (dir == NULL) {
+    printErr(__FILE__, __LINE__, "malloc failed", 0, 0);
+    return NULL;
+  }
+  sprintf(dir, "%s/slot%d", cg, slot);
+  if (mkdir(dir, S_IRWXU) == -1 && errno != EEXIST) {
+    printErr(__FILE__, __LINE__, "mkdir failed", 1, errno);
+    free(dir);
+    return NULL;
+  }
+  return dir;
+}
+
+/*
+  Replaces the content of |dir|/|file_name| with |str|
+*/
+static int writeSlotFile(
+  const char *dir, const char *file_name, const char *str) {
+
+  char path[strlen(dir) + strlen(file_name) + 2];
+  sprintf(path, "%s/%s", dir, file_name);
+  int f = open(path, O_WRONLY);
+  if (f == -1) {
+    printErr(__FILE__, __LINE__, "open failed", 1, errno);
+    return -1;
+  }
+  if (write(f, str, strlen(str)) == -1) {
+    printErr(__FILE__, __LINE__, "write failed", 1, errno);
+    close(f);
+    return -1;
+  }
+  if (close(f) == -1) {
+    printErr(__FILE__, __LINE__, "close failed", 1, errno);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+  Pins the calling worker to |cpu|. Affinity and cpuset membership are both
+  inherited, hence every executable the worker sandboxes runs on |cpu| only
+  and two slots never compete for a core (the 'cpuacct.usage' of a run is
+  then not inflated by another run's cache and scheduler noise).
+*/
+static int pinToCpu(const CgroupLocs *cg_locs, int slot, int cpu) {
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+    printErr(__FILE__, __LINE__, "sched_setaffinity failed", 1, errno);
+    return -1;
+  }
+  // without a cpuset the sandboxed executable could widen its affinity
+  // again if 'sched_setaffinity' were ever whitelisted. The v2 cpuset is
+  // handled by 'createUnifiedSlot'.
+  if (cg_locs -> cpuset == NULL || cg_locs -> unified != NULL) {
+    return 0;
+  }
+
+  char *dir = createSlotDir(cg_locs -> cpuset, slot);
+  if (dir == NULL) {
+    printErr(__FILE__, __LINE__, "createSlotDir failed", 0, 0);
+    return -1;
+  }
+  // 'cpuset.mems' must be set before a task can join, take the parent's
+  char mems_path[strlen(cg_locs -> cpuset) + 13];
+  sprintf(mems_path, "%s/cpuset.mems", cg_locs -> cpuset);
+  char mems[64];
+  int f = open(mems_path, O_RDONLY);
+  ssize_t len;
+  if (f == -1 || (len = read(f, mems, sizeof(mems) - 1)) <= 0) {
+    printErr(__FILE__, __LINE__, "reading cpuset.mems failed", 1, errno);
+    if (f != -1) {
+      close(f);
+    }
+    free(dir);
+    return -1;
+  }
+  close(f);
+  mems[len] = '\0';
+
+  char buf[16];
+  sprintf(buf, "%d", cpu);
+  int ret = 0;
+  if (writeSlotFile(dir, "cpuset.mems", mems) == -1 ||
+    writeSlotFile(dir, "cpuset.cpus", buf) == -1) {
+    printErr(__FILE__, __LINE__, "writeSlotFile failed", 0, 0);
+    ret = -1;
+  } else {
+    sprintf(buf, "%d", getpid());
+    if (writeSlotFile(dir, "tasks", buf) == -1) {
+      printErr(__FILE__, __LINE__, "writeSlotFile failed", 0, 0);
+      ret = -1;
+    }
+  }
+  free(dir);
+  return ret;
+}
+
+/*
+  Creates the v2 slot cgroup |unified|/slot|slot| and enables the controllers
+  its per-run children need. With a cpuset requested, the slot's
+  'cpuset.cpus' confines every run below it to |cpu|; v2 does not allow the
+  worker itself to join a cgroup that has children with controllers.
+
+  Returns:
+    NULL on error
+    a malloc'd NTCS |unified|/slot|slot| on success
+*/
+static char *createUnifiedSlot(const CgroupLocs *cg_locs, int slot, int cpu) {
+
+  char *dir = createSlotDir(cg_locs -> unified, slot);
+  if (dir == NULL) {
+    return NULL;
+  }
+  const char *controllers = cg_locs -> cpuset != NULL ?
+    "+memory +pids +cpu +cpuset" : "+memory +pids +cpu";
+  if (writeSlotFile(dir, "cgroup.subtree_control", controllers) == -1) {
+    printErr(__FILE__, __LINE__, "writeSlotFile failed", 0, 0);
+    free(dir);
+    return NULL;
+  }
+  if (cg_locs -> cpuset != NULL) {
+    char buf[16];
+    sprintf(buf, "%d", cpu);
+    if (writeSlotFile(dir, "cpuset.cpus", buf) == -1) {
+      printErr(__FILE__, __LINE__, "writeSlotFile failed", 0, 0);
+      free(dir);
+      return NULL;
+    }
+  }
+  return dir;
+}
+
+/*
+  Body of the worker process serving slot |slot|. The slot owns one CPU and
+  its own cgroup subtree (|cg|/slot|slot| for each controller), so runs in
+  different slots share nothing. Each accepted connection is greeted with
+  the slot number before the batch is read.
+
+  Never returns.
+*/
+static void runWorker(
+  int sock, int slot, int cpu, const CgroupLocs *cg_locs,
+  const char *whitelist, uid_t uid, gid_t gid) {
+
+  if (pinToCpu(cg_locs, slot, cpu) == -1) {
+    printErr(__FILE__, __LINE__, "pinToCpu failed", 0, 0);
+    exit(SB_FAILURE);
+  }
+  setInputCacheSize(SERVER_INPUT_CACHE_SIZE);
+  CgroupLocs slot_locs;
+  slot_locs.cpuset = NULL;
+  slot_locs.pool_size = cg_locs -> pool_size;
+  slot_locs.pool_refill = cg_locs -> pool_refill;
+  if (cg_locs -> unified != NULL) {
+    slot_locs.memory = slot_locs.cpuacct = slot_locs.pids = NULL;
+    if ((slot_locs.unified = createUnifiedSlot(cg_locs, slot, cpu)) == NULL) {
+      printErr(__FILE__, __LINE__, "createUnifiedSlot failed", 0, 0);
+      exit(SB_FAILURE);
+    }
+  } else {
+    slot_locs.unified = NULL;
+    slot_locs.memory = createSlotDir(cg_locs -> memory, slot);
+    slot_locs.cpuacct = createSlotDir(cg_locs -> cpuacct, slot);
+    slot_locs.pids = createSlotDir(cg_locs -> pids, slot);
+    if (slot_locs.memory == NULL || slot_locs.cpuacct == NULL ||
+      slot_locs.pids == NULL) {
+      printErr(__FILE__, __LINE__, "createSlotDir failed", 0, 0);
+      exit(SB_FAILURE);
+    }
+  }
+
+  while (1) {
+    int conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+    if (conn == -1) {
+      if (errno != EINTR) {
+        printErr(__FILE__, __LINE__, "accept failed", 1, errno);
+      }
+      continue;
+    }
+    if (dprintf(conn, "%d\n", slot) < 0) {
+      printErr(__FILE__, __LINE__, "dprintf failed", 1, errno);
+    } else {
+      serveConnection(conn, &slot_locs, whitelist, uid, gid);
+    }
+    if (close(conn) == -1) {
+      printErr(__FILE__, __LINE__, "close failed", 1, errno);
+    }
+  }
+}
+
+static pid_t startWorker(
+  int sock, int slot, int cpu, const CgroupLocs *cg_locs,
+  const char *whitelist, uid_t uid, gid_t gid) {
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    printErr(__FILE__, __LINE__, "fork failed", 1, errno);
+  } else if (pid == 0) {
+    runWorker(sock, slot, cpu, cg_locs, whitelist, uid, gid);
+  }
+  return pid;
+}
+
+/*
+  Listens on the Unix socket |socket_path| and runs every received batch
+  through 'sandboxExecBatch'. |slots| worker processes share the socket and
+  each serves one batch at a time; slot i is pinned to CPU |first_cpu| + i.
+  A worker that dies is restarted.
+
+  Returns:
+    -1 on failure to set up the socket, otherwise never returns
+*/
+int runSandboxServer(
+  const char *socket_path, const CgroupLocs *cg_locs,
+  const char *whitelist, uid_t uid, gid_t gid, int slots, int first_cpu) {
+
+  if (slots < 1) {
+    printErr(__FILE__, __LINE__, "at least one slot is required", 0, 0);
+    return -1;
+  }
+
+  // a client closing its end early must not take the server down
+  signal(SIGPIPE, SIG_IGN);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    printErr(__FILE__, __LINE__, "socket path too long", 0, 0);
+    return -1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock == -1) {
+    printErr(__FILE__, __LINE__, "socket failed", 1, errno);
+    return -1;
+  }
+  // remove the socket left behind by a previous instance
+  if (unlink(socket_path) == -1 && errno != ENOENT) {
+    printErr(__FILE__, __LINE__, "unlink failed", 1, errno);
+    close(sock);
+    return -1;
+  }
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    printErr(__FILE__, __LINE__, "bind failed", 1, errno);
+    close(sock);
+    return -1;
+  }
+  // the server runs as root and executes whatever it is asked to, hence only
+  // root may connect
+  if (chmod(socket_path, S_IRUSR | S_IWUSR) == -1) {
+    printErr(__FILE__, __LINE__, "chmod failed", 1, errno);
+    close(sock);
+    return -1;
+  }
+  if (listen(sock, SERVER_BACKLOG) == -1) {
+    printErr(__FILE__, __LINE__, "listen failed", 1, errno);
+    close(sock);
+    return -1;
+  }
+
+  pid_t *workers = malloc(sizeof(pid_t) * slots);
+  if (workers == NULL) {
+    printErr(__FILE__, __LINE__, "malloc failed", 0, 0);
+    close(sock);
+    return -1;
+  }
+  int i;
+  for (i = 0; i < slots; i++) {
+    workers[i] = startWorker(
+      sock, i, first_cpu + i, cg_locs, whitelist, uid, gid);
+  }
+
+  while (1) {
+    int wstatus;
+    pid_t pid = wait(&wstatus);
+    if (pid == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printErr(__FILE__, __LINE__, "wait failed", 1, errno);
+      // no worker left to wait for; bring all of them back
+      for (i = 0; i < slots; i++) {
+        workers[i] = -1;
+      }
+    }
+    for (i = 0; i < slots; i++) {
+      if (workers[i] == pid || workers[i] == -1) {
+        printErr(__FILE__, __LINE__, "restarting worker", 0, 0);
+        // avoid spinning when a worker keeps failing at startup
+        sleep(1);
+        workers[i] = startWorker(
+          sock, i, first_cpu + i, cg_locs, whitelist, uid, gid);
+      }
+    }
+  }
+}
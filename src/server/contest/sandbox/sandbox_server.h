@@ -0,0 +1,40 @@
+#ifndef SANDBOX_SERVER_H_
+#define SANDBOX_SERVER_H_
+
+#include <sys/types.h>
+
+#include "resource_limits.h"
+
+/*
+  Protocol (one batch per connection, all lines end with '\n' and fields are
+  separated by a single '\t'):
+
+    server: <slot>                           (on connect)
+    client: <exect_path> <jail_path> <mem> <cpu_time> <num_tasks>
+            [<output> [<profile> [<wall_time>]]]
+    client: <input_file> <output_file>       (repeated, one line per job)
+    client: <empty line>                     (end of batch)
+    server: <verdict> <cpu_time> <wall_time> <peak_mem> <peak_tasks>
+            <exit_code> <signal> <output_bytes> <clone> <ready>
+            <limits> <release> <exit> <cleanup> <judge_cpu>
+                                             (one line per job, in order,
+                                              sent as soon as the job ran)
+
+  'exect_path' is relative to 'jail_path', exactly like for 'sandboxExec'.
+  'output' is the optional output limit in bytes, see 'ResLimits'.
+  'profile' names a language profile of 'profiles.c' to use instead of the
+  server's whitelist, or "-" for none; with one, any limit may be "-" for
+  the profile's default. 'wall_time' is in nanoseconds, see 'ResLimits'.
+  'verdict' is one of the SB_* return values of 'sandboxExec', the other
+  fields are those of 'SandboxResult' (see 'formatSandboxResult'), the
+  last seven those of its 'SandboxTrace'.
+  'slot' identifies the worker serving the connection; the client should use
+  a jail and output files of its own per slot, since runs in different slots
+  happen at the same time.
+*/
+
+int runSandboxServer(
+  const char *socket_path, const CgroupLocs *cg_locs,
+  const char *whitelist, uid_t uid, gid_t gid, int slots, int first_cpu);
+
+#endif
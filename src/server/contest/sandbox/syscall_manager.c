@@ -1,82 +1,254 @@
+#define _GNU_SOURCE // for memfd_create(); has to be before the #includes
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <seccomp.h>
 #include <errno.h>
+#include <unistd.h> // pread(), close()
+#include <sys/mman.h> // memfd_create()
+#include <sys/stat.h> // fstat()
+#include <sys/prctl.h> // prctl()
+#include <linux/seccomp.h> // SECCOMP_MODE_FILTER
 
 #include "logger.h"
+#include "syscall_manager.h"
 
-static int installSysCallBlockerCleanup(
-  scmp_filter_ctx *ctx, char *buf, FILE *fp) {
+static int addSysCall(SysCallList *scl, int *cap, const char *name) {
 
-  seccomp_release(*ctx);
-  free(buf);
-  if (fclose(fp) != 0) {
-    printErr(__FILE__, __LINE__, "fclose failed", 1, errno);
+  int num = seccomp_syscall_resolve_name(name);
+  if (num == __NR_SCMP_ERROR) {
+    printErr(__FILE__, __LINE__, "unknown system call in whitelist", 0, 0);
     return -1;
   }
+  if (scl -> len == *cap) {
+    *cap = *cap * 2;
+    int *syscalls = realloc(scl -> syscalls, sizeof(int) * (*cap));
+    if (syscalls == NULL) {
+      printErr(__FILE__, __LINE__, "realloc failed", 0, 0);
+      return -1;
+    }
+    scl -> syscalls = syscalls;
+  }
+  scl -> syscalls[scl -> len++] = num;
   return 0;
 }
 
-int installSysCallBlocker(scmp_filter_ctx *ctx, int whitelist_fd) {
+/*
+  Returns:
+    NULL on failure
+    a libseccomp filter allowing the system calls of |scl| on success
+*/
+static scmp_filter_ctx buildFilter(const SysCallList *scl) {
 
-  FILE *fp = fdopen(whitelist_fd, "r");
-  if (fp == NULL) {
-    printErr(__FILE__, __LINE__, "fopen failed", 1, errno);
+  scmp_filter_ctx ctx = seccomp_init(SCMP_ACT_ERRNO(EPERM));
+  if (ctx == NULL) {
+    printErr(__FILE__, __LINE__, "seccomp_init failed", 0, 0);
+    return NULL;
+  }
+
+  int ret, i;
+  for (i = 0; i < scl -> len; i++) {
+    if ((ret = seccomp_rule_add(
+      ctx, SCMP_ACT_ALLOW, scl -> syscalls[i], 0)) < 0) {
+      printErr(__FILE__, __LINE__, "seccomp_rule_add failed", 1, -ret);
+      seccomp_release(ctx);
+      return NULL;
+    }
+  }
+  return ctx;
+}
+
+/*
+  Compiles the filter of |scl| into 'scl -> prog' through
+  'seccomp_export_bpf'.
+
+  Resource residue (when return value == 0):
+    'scl -> prog.filter' malloc, freed by 'freeSysCallList'
+*/
+static int compileFilter(SysCallList *scl) {
+
+  scmp_filter_ctx ctx = buildFilter(scl);
+  if (ctx == NULL) {
+    return -1;
+  }
+  int fd = memfd_create("seccomp-bpf", MFD_CLOEXEC);
+  if (fd == -1) {
+    printErr(__FILE__, __LINE__, "memfd_create failed", 1, errno);
+    seccomp_release(ctx);
+    return -1;
+  }
+  int ret = seccomp_export_bpf(ctx, fd);
+  seccomp_release(ctx);
+  if (ret < 0) {
+    printErr(__FILE__, __LINE__, "seccomp_export_bpf failed", 1, -ret);
+    close(fd);
     return -1;
   }
 
-  *ctx = seccomp_init(SCMP_ACT_ERRNO(EPERM));
-  if (*ctx == NULL) {
-    printErr(__FILE__, __LINE__, "seccomp_init failed", 0, 0);
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    printErr(__FILE__, __LINE__, "fstat failed", 1, errno);
+    close(fd);
     return -1;
   }
+  struct sock_filter *filter = malloc(st.st_size);
+  if (filter == NULL || pread(fd, filter, st.st_size, 0) != st.st_size) {
+    printErr(__FILE__, __LINE__, "reading the exported filter failed", 0, 0);
+    free(filter);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  scl -> prog.filter = filter;
+  scl -> prog.len = st.st_size / sizeof(struct sock_filter);
+  return 0;
+}
+
+/*
+  Returns:
+    0 on success
+    -1 on failure
 
-  // Add filters for default whitelist
+  Resource residue (when return value == 0):
+    1 int malloc - 'scl -> syscalls', freed by 'freeSysCallList'
+    'scl -> prog.filter' malloc (if compiled), freed by 'freeSysCallList'
+*/
+int loadSysCallList(const char *whitelist, SysCallList *scl) {
+
+  int cap = 32;
+  scl -> len = 0;
+  scl -> prog.filter = NULL;
+  scl -> prog.len = 0;
+  scl -> syscalls = malloc(sizeof(int) * cap);
+  if (scl -> syscalls == NULL) {
+    printErr(__FILE__, __LINE__, "malloc failed", 0, 0);
+    return -1;
+  }
+
+  // Default whitelist
   const char *def_wl[] = {"exit_group", "execve"};
-  int ret, i, def_wl_len = sizeof(def_wl)/sizeof(def_wl[0]);
+  int i, def_wl_len = sizeof(def_wl)/sizeof(def_wl[0]);
   for (i = 0; i < def_wl_len; i++) {
-    if ((ret = seccomp_rule_add(
-      *ctx, SCMP_ACT_ALLOW,
-      seccomp_syscall_resolve_name(def_wl[i]), 0)) < 0) {
-      printErr(__FILE__, __LINE__, "seccomp_rule_add failed", 1, -ret);
-      if (installSysCallBlockerCleanup(ctx, NULL, fp) == -1) {
-        printErr(
-          __FILE__, __LINE__, "installSysCallBlockerCleanup failed", 0,
-          0);
-      }
+    if (addSysCall(scl, &cap, def_wl[i]) == -1) {
+      freeSysCallList(scl);
       return -1;
     }
   }
 
-  // Add filters for user's whitelist
+  FILE *fp = fopen(whitelist, "r");
+  if (fp == NULL) {
+    printErr(__FILE__, __LINE__, "fopen failed", 1, errno);
+    freeSysCallList(scl);
+    return -1;
+  }
+
+  // User's whitelist
   int max_syscall_len = 25;
-  char *buf = malloc(sizeof(char) * max_syscall_len);
+  char buf[max_syscall_len];
   // TODO: first call to execl should be allowed
   while (fgets(buf, max_syscall_len, fp) != NULL) {
     buf[strlen(buf) - 1] = '\0';
-    if ((ret = seccomp_rule_add(
-      *ctx, SCMP_ACT_ALLOW, seccomp_syscall_resolve_name(buf), 0)) < 0) {
-      printErr(__FILE__, __LINE__, "seccomp_rule_add failed", 1, -ret);
-      if (installSysCallBlockerCleanup(ctx, buf, fp) == -1) {
-        printErr(
-          __FILE__, __LINE__, "installSysCallBlockerCleanup failed", 0,
-          0);
-      }
+    if (addSysCall(scl, &cap, buf) == -1) {
+      freeSysCallList(scl);
+      fclose(fp);
       return -1;
     }
   }
 
-  // Free resources
-  free(buf);
   if (fclose(fp) != 0) {
     printErr(__FILE__, __LINE__, "fclose failed", 1, errno);
   }
+  if (compileFilter(scl) == -1) {
+    // not fatal: 'installSysCallBlocker' builds the filter in the child
+    printErr(__FILE__, __LINE__, "compileFilter failed", 0, 0);
+  }
+  return 0;
+}
+
+/*
+  Like 'loadSysCallList', with the user's whitelist given as the |len|
+  system call numbers |syscalls| instead of a file of names.
+
+  Returns:
+    0 on success
+    -1 on failure
+
+  Resource residue (when return value == 0):
+    same as 'loadSysCallList'
+*/
+int initSysCallList(const int *syscalls, int len, SysCallList *scl) {
+
+  int cap = len + 2;
+  scl -> len = 0;
+  scl -> prog.filter = NULL;
+  scl -> prog.len = 0;
+  scl -> syscalls = malloc(sizeof(int) * cap);
+  if (scl -> syscalls == NULL) {
+    printErr(__FILE__, __LINE__, "malloc failed", 0, 0);
+    return -1;
+  }
+
+  // Default whitelist
+  if (addSysCall(scl, &cap, "exit_group") == -1 ||
+    addSysCall(scl, &cap, "execve") == -1) {
+    freeSysCallList(scl);
+    return -1;
+  }
+
+  int i;
+  for (i = 0; i < len; i++) {
+    // negative numbers are libseccomp's pseudo numbers for system calls
+    // this architecture does not have
+    if (syscalls[i] >= 0) {
+      scl -> syscalls[scl -> len++] = syscalls[i];
+    }
+  }
+
+  if (compileFilter(scl) == -1) {
+    printErr(__FILE__, __LINE__, "compileFilter failed", 0, 0);
+  }
+  return 0;
+}
+
+void freeSysCallList(SysCallList *scl) {
+
+  free(scl -> syscalls);
+  scl -> syscalls = NULL;
+  scl -> len = 0;
+  free(scl -> prog.filter);
+  scl -> prog.filter = NULL;
+}
+
+int installSysCallBlocker(const SysCallList *scl) {
+
+  if (scl -> prog.filter != NULL) {
+    // what 'seccomp_load' does too: a process that is not root may only
+    // install a filter once it can gain no privileges
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1) {
+      printErr(__FILE__, __LINE__, "prctl failed", 1, errno);
+      return -1;
+    }
+    if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &(scl -> prog)) == -1) {
+      printErr(__FILE__, __LINE__, "prctl failed", 1, errno);
+      return -1;
+    }
+    return 0;
+  }
+
+  scmp_filter_ctx ctx = buildFilter(scl);
+  if (ctx == NULL) {
+    return -1;
+  }
 
   // Load the filter
-  if ((ret = seccomp_load(*ctx)) < 0) {
+  int ret;
+  if ((ret = seccomp_load(ctx)) < 0) {
     printErr(__FILE__, __LINE__, "seccomp_load failed", 1, -ret);
+    seccomp_release(ctx);
     return -1;
   }
+  // 'ctx' is not released: that could make system calls which the filter
+  // now blocks, and the memory is gone with the upcoming exec anyway
   return 0;
-}
\ No newline at end of file
+}
@@ -1,12 +1,38 @@
 #ifndef SYSCALL_MANAGER_H
 #define SYSCALL_MANAGER_H
 
-#include <seccomp.h>
+#include <linux/filter.h> // struct sock_fprog
+
+typedef struct SysCallList {
+  int *syscalls; // system call numbers, resolved from their names
+  int len;
+  // the filter for 'syscalls', compiled to BPF by 'loadSysCallList'.
+  // 'prog.filter' is NULL if compiling failed, in which case the child
+  // builds the filter itself.
+  struct sock_fprog prog;
+} SysCallList;
+
+/*
+  Reads the file |whitelist|, which contains one system call name per line,
+  and resolves every name. The default whitelist is included too. The
+  filter is compiled to BPF right away, so that every child of the session
+  installs the same program.
+*/
+int loadSysCallList(const char *whitelist, SysCallList *scl);
+
+/*
+  Same as 'loadSysCallList' for a whitelist of system call numbers, such as
+  the tables of 'profiles.c'.
+*/
+int initSysCallList(const int *syscalls, int len, SysCallList *scl);
+
+void freeSysCallList(SysCallList *scl);
 
 /*
-  'ctx' is the filter context and 'whitelist' is the fd to an 'open(2)'ed
-  file which contains system calls that should be allowed.
+  Installs a filter that allows only the system calls in |scl|. Meant to be
+  called from the sandboxed child, so it neither reads files nor resolves
+  names; with a compiled filter it takes just two 'prctl' calls.
 */
-int installSysCallBlocker(scmp_filter_ctx *ctx, int whitelist_fd);
+int installSysCallBlocker(const SysCallList *scl);
 
-#endif
\ No newline at end of file
+#endif
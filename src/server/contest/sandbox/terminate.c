@@ -1,67 +1,89 @@
 #include <sys/types.h>
-#include <math.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
-#include <unistd.h>
+#include <unistd.h> // syscall()
 #include <signal.h>
 #include <errno.h>
-#include <sys/types.h>
+#include <fcntl.h> // open()
+#include <limits.h> // INT_MAX
+#include <time.h> // clock_gettime()
+#include <sys/syscall.h> // SYS_futex
+#include <linux/futex.h> // FUTEX_WAIT_PRIVATE, FUTEX_WAKE_PRIVATE
 
 #include "terminate.h"
 #include "resource_limits.h"
 #include "logger.h"
 
-static char *getPidDir(const char *cg, pid_t pid) {
+/*
+  Sleeps until '*flag' becomes 1. A wake-up that finds it still 0 (spurious,
+  or EINTR) just waits again; if it was set in between, FUTEX_WAIT returns
+  at once with EAGAIN.
+*/
+static void waitFlag(atomic_int *flag) {
 
-  char *pid_dir = malloc(
-    sizeof(char) * (strlen(cg) + (int)ceil(log10(pid)) + 2));
-  sprintf(pid_dir, "%s/%d", cg, pid);
-  return pid_dir;
+  while (atomic_load(flag) == 0) {
+    syscall(SYS_futex, (int *)flag, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+  }
 }
 
-int removePidDirs(const CgroupLocs *cg_locs, pid_t pid) {
-  char *memory_cg = getPidDir(cg_locs -> memory, pid);
-  char *cpuacct_cg = getPidDir(cg_locs -> cpuacct, pid);
-  char *pids_cg = getPidDir(cg_locs -> pids, pid);
+static long long threadCpuNs(clockid_t clock) {
 
-  int ret = 0;
-  if (rmdir(memory_cg) == -1) {
-    printErr(__FILE__, __LINE__, "rmdir failed", 1, errno);
-    ret = -1;
-  }
-  if (rmdir(cpuacct_cg) == -1) {
-    printErr(__FILE__, __LINE__, "rmdir failed", 1, errno);
-    ret = -1;
-  }
-  if (rmdir(pids_cg) == -1) {
-    printErr(__FILE__, __LINE__, "rmdir failed", 1, errno);
-    ret = -1;
+  struct timespec ts;
+  if (clock_gettime(clock, &ts) == -1) {
+    return 0;
   }
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void setFlag(atomic_int *flag) {
 
-  free(memory_cg);
-  free(cpuacct_cg);
-  free(pids_cg);
+  atomic_store(flag, 1);
+  syscall(SYS_futex, (int *)flag, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/*
+  Kills every process in the v2 cgroup of the sandboxed executable at once
+  through 'cgroup.kill' (Linux 5.14+).
+
+  Returns:
+    0 on success
+    -1 if 'cgroup.kill' is not available or could not be written
+*/
+static int killCgroup(const CgroupDirs *dirs) {
+
+  char path[strlen(dirs -> unified) + 13];
+  sprintf(path, "%s/cgroup.kill", dirs -> unified);
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return -1;
+  }
+  int ret = write(fd, "1", 1) == 1 ? 0 : -1;
+  close(fd);
   return ret;
 }
 
 int terminate(TerminatePayload *tp) {
-  // Just for safety so that the function doesn't get called twice
-  if (tp -> once == 1) {
+  // whoever comes second (the monitor or the reaping thread) leaves it to
+  // the first
+  if (atomic_exchange(&(tp -> once), 1) == 1) {
     return 0;
   }
-  tp -> once = 1;
   int ret = 0;
-  if (!(tp -> terminated)) {
+  if (!atomic_load(&(tp -> terminated))) {
     // TODO: handle corner case of killing init in PID NS
-    if (kill(tp -> pid, SIGKILL) == -1) {
+    // with cgroup v2 every task of the executable goes at once, not just
+    // its first one
+    int killed = tp -> dirs -> unified != NULL &&
+      killCgroup(tp -> dirs) == 0;
+    if (!killed && kill(tp -> pid, SIGKILL) == -1) {
       printErr(__FILE__, __LINE__, "kill failed", 1, errno);
       ret = -1;
     }
 
     // wait until 'sandboxExec' confirms the process has terminated
-    while (tp -> terminated == 0);
+    waitFlag(&(tp -> terminated));
 
     #ifdef SB_VERBOSE
     printf("Killed %d\n", tp -> pid);
@@ -69,8 +91,18 @@ int terminate(TerminatePayload *tp) {
   }
 
   int i;
+  tp -> caller = -1;
+  tp -> threads_cpu = 0;
   for (i = 0; i < (tp -> threads_len); i++) {
-    if ((tp -> skip == NULL) || pthread_equal((tp -> threads)[i], *(tp -> skip)) == 0) {
+    clockid_t clock;
+    if (pthread_equal((tp -> threads)[i], pthread_self())) {
+      tp -> caller = i;
+      tp -> threads_cpu += threadCpuNs(CLOCK_THREAD_CPUTIME_ID);
+    } else {
+      // not cancelled yet, so still alive
+      if (pthread_getcpuclockid((tp -> threads)[i], &clock) == 0) {
+        tp -> threads_cpu += threadCpuNs(clock);
+      }
       pthread_cancel((tp -> threads)[i]);
       #ifdef SB_VERBOSE
       printf("Killed thread: %d\n", i);
@@ -79,10 +111,28 @@ int terminate(TerminatePayload *tp) {
     }
   }
 
-  if (removePidDirs(tp -> cg_locs, tp -> pid) == -1) {
-    printErr(__FILE__, __LINE__, "removePidDirs failed", 1, errno);
+  if (releaseCgroupDirs(tp -> dirs) == -1) {
+    printErr(__FILE__, __LINE__, "releaseCgroupDirs failed", 0, 0);
     ret = -1;
   }
-  tp -> done = 1;
-  return 0;
-}
\ No newline at end of file
+  setFlag(&(tp -> done));
+  return ret;
+}
+
+long long terminateReaped(TerminatePayload *tp) {
+
+  setFlag(&(tp -> terminated));
+  // cancels the monitor, unless it is terminating the run already
+  if (terminate(tp) == -1) {
+    printErr(__FILE__, __LINE__, "terminate failed", 0, 0);
+  }
+  waitFlag(&(tp -> done));
+  if (tp -> caller != -1) {
+    // the monitor that ran 'terminate' exits right after it
+    pthread_join((tp -> threads)[tp -> caller], NULL);
+  }
+  long long threads_cpu = tp -> threads_cpu;
+  free(tp -> threads);
+  free(tp);
+  return threads_cpu;
+}
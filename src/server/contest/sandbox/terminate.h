@@ -2,24 +2,50 @@
 #define TERMINATE_H_
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <sys/types.h>
 
 #include "resource_limits.h"
+#include "cgroup_pool.h"
 
+/*
+  Shared by the monitor thread(s) of a run and the thread that reaps the
+  sandboxed executable. The flags only ever go from 0 to 1; waiting for one
+  sleeps on a futex, so neither side burns cpu while the other catches up.
+*/
 typedef struct TerminatePayload {
-  pthread_t *threads;
-  // threads[i] that is equal to *skip is not cancelled; all others are
-  pthread_t *skip;
+  pthread_t *threads; // all are cancelled except the one calling 'terminate'
   int threads_len;
-  int terminated; // 1 if the sandboxed executable is terminated
-  int done; // becomes 1 (from 0) when the 'terminate' completes once
-  int once; // 1 if 'terminate' is called atleast once else 0
+  atomic_int terminated; // 1 once the sandboxed executable is reaped
+  atomic_int done; // 1 once 'terminate' completed
+  atomic_int once; // 1 once 'terminate' was called
+  // index in 'threads' of the thread that ran 'terminate', which is left for
+  // 'terminateReaped' to join; -1 if it was not one of them. Written before
+  // 'done'.
+  int caller;
+  // cpu time (nanoseconds) the threads of 'threads' used, read by
+  // 'terminate' while they are still alive. Written before 'done'.
+  long long threads_cpu;
   pid_t pid;
-  const CgroupLocs *cg_locs;
+  CgroupDirs *dirs; // released by 'terminate'
 } TerminatePayload;
 
-int removePidDirs(const CgroupLocs *cg_locs, pid_t pid);
-
+/*
+  Kills the sandboxed executable unless it was reaped already, waits until
+  it is, stops the other threads of 'threads' and releases the cgroup
+  directories. Only the first call does anything; later ones return 0 at
+  once.
+*/
 int terminate(TerminatePayload *tp);
 
-#endif
\ No newline at end of file
+/*
+  To be called by the thread that reaped the sandboxed executable, once
+  nothing more is needed from the cgroup directories. Runs 'terminate' if no
+  monitor did, waits for it to complete either way and frees |tp|.
+
+  Returns:
+    'threads_cpu' of |tp|
+*/
+long long terminateReaped(TerminatePayload *tp);
+
+#endif
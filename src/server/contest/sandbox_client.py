@@ -0,0 +1,113 @@
+import os
+import socket
+from concurrent.futures import ThreadPoolExecutor
+from .sandbox_config import *
+from . import metrics
+from . import jails
+
+# fields of a result line after the verdict, see SandboxResult in
+# sandbox/sandbox.h; times are in nanoseconds, sizes in bytes
+RESULT_FIELDS = ["cpu_time", "wall_time", "peak_mem", "peak_tasks", "exit_code", "signal", "output_bytes"]
+# fields of SandboxTrace that end the line: when each phase of the run ended,
+# in nanoseconds from its start, and the cpu time the sandbox spent on it
+TRACE_FIELDS = ["clone", "ready", "limits", "release", "exit", "cleanup", "judge_cpu"]
+
+# limits of a run. Values are numbers (nanoseconds, bytes; see ResLimits in
+# sandbox/resource_limits.h) or "-" for the default of the sandbox profile
+LIMIT_FIELDS = ["mem", "cpu_time", "num_tasks", "output", "wall_time"]
+
+def default_limits():
+    """ Limits of sandbox_config, for runs nothing sets limits of their own """
+    return {"mem": MEMORY_LIMIT, "cpu_time": TIME_LIMIT, "num_tasks": MAX_PIDS, "output": OUTPUT_LIMIT, "wall_time": WALL_TIME_LIMIT}
+
+def parse_result(line):
+    """ Turns one result line of the sandbox into a dict holding 'verdict',
+        RESULT_FIELDS and, under 'trace', TRACE_FIELDS. Values the sandbox
+        could not measure are -1 """
+    values = [int(v) for v in line.split()]
+    fields = ["verdict"] + RESULT_FIELDS
+    result = dict(zip(fields, values))
+    if len(values) >= len(fields) + len(TRACE_FIELDS):
+        result["trace"] = dict(zip(TRACE_FIELDS, values[len(fields):]))
+    return result
+
+def failed_result():
+    """ Result of a job the sandbox did not report on """
+    result = dict.fromkeys(RESULT_FIELDS, -1)
+    result["verdict"] = 1
+    return result
+
+def send_batch(sock, response, header, jobs, on_result=None):
+    """ Sends one batch over a connection whose greeting was read already.
+        header holds the fields of the first line, jobs (input_file, output_file)
+        pairs. Returns one result (see parse_result) per job, and passes each
+        to on_result(index, result) as soon as the server sent it """
+    lines = ["\t".join(header)]
+    for input_file, output_file in jobs:
+        lines.append(input_file + "\t" + output_file)
+    request = "\n".join(lines) + "\n\n"
+    sock.sendall(request.encode())
+
+    results = []
+    for line in response:
+        results.append(parse_result(line))
+        if on_result is not None:
+            on_result(len(results) - 1, results[-1])
+    # server rejected the batch or died midway; report as sandbox failure
+    while len(results) < len(jobs):
+        results.append(failed_result())
+        if on_result is not None:
+            on_result(len(results) - 1, results[-1])
+    return results
+
+def run_batch(executable_path, input_files, output_dir, profile, limits=None, on_result=None):
+    """ Runs executable_path once per input file, as one batch, on whichever slot
+        the sandbox server hands out, under the sandbox profile named profile
+        and limits (see LIMIT_FIELDS; default_limits() if None).
+        Returns a list of (result, output_file). If given, on_result(index,
+        result, output_file) is called as soon as each run ended, so that its
+        output may be compared and removed before the batch is done.
+        The protocol is described in sandbox/sandbox_server.h """
+    limits = limits or default_limits()
+    with metrics.busy_slot(), socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(SANDBOX_SOCKET)
+        response = sock.makefile('r')
+        # the slot is ours until the connection is closed
+        slot = int(response.readline())
+        jail_dir = jails.slot_jail(slot)
+        jails.install(jail_dir, executable_path)
+        try:
+            output_files = [output_dir + '/' + os.path.basename(f) for f in input_files]
+            header = [EXECUTABLE_FILE, jail_dir] + [str(limits[f]) for f in ["mem", "cpu_time", "num_tasks", "output"]] + [profile, str(limits["wall_time"])]
+            done = None if on_result is None else lambda i, result: on_result(i, result, output_files[i])
+            results = send_batch(sock, response, header, list(zip(input_files, output_files)), done)
+        finally:
+            # while the slot is still ours
+            jails.reset(jail_dir)
+    return list(zip(results, output_files))
+
+def chunk_callback(on_result, chunk, n):
+    """ on_result of the batch input_files[chunk::n] of run_parallel, which
+        turns the batch's indices back into those of input_files """
+    if on_result is None:
+        return None
+    return lambda i, result, output_file: on_result(chunk + i * n, result, output_file)
+
+def run_parallel(executable_path, input_files, output_dir, profile, limits=None, on_result=None):
+    """ Splits input_files over up to SANDBOX_SLOTS batches that run at the same
+        time. Returns (result, output_file) in the order of input_files;
+        on_result as for run_batch, with indices of input_files, called from
+        the threads of the batches """
+    n = min(SANDBOX_SLOTS, len(input_files))
+    if n <= 1:
+        return run_batch(executable_path, input_files, output_dir, profile, limits, on_result)
+
+    # interleaved so that slow, large testcases (usually numbered last) spread out
+    chunks = [input_files[i::n] for i in range(n)]
+    with ThreadPoolExecutor(max_workers=n) as pool:
+        results = list(pool.map(lambda c: run_batch(executable_path, chunks[c], output_dir, profile, limits, chunk_callback(on_result, c, n)), range(n)))
+
+    ordered = [None] * len(input_files)
+    for i, chunk_results in enumerate(results):
+        ordered[i::n] = chunk_results
+    return ordered
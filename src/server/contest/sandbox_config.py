@@ -1,16 +1,117 @@
 import os
 
 EXE = os.getcwd() + "/contest/sandbox/sandbox-exe"
-MEMORY_LIMIT = "1M"
-TIME_LIMIT = "1000000000" #in nano( 10^-9 ) seconds
-MAX_PIDS = "4"
-MEMORY_CGROUP = "/sys/fs/cgroup/memory/test"
-CPUACCT_CGROUP = "/sys/fs/cgroup/cpuacct/test/"
-PIDS_CGROUP = "/sys/fs/cgroup/pids/test/"
-JAIL_DIR = os.getcwd() + "/contest/sandbox/jail/"
+# Limits of problems that set none of their own (see contest.Problem);
+# "-" takes the default of the language's sandbox profile (see LANGUAGES)
+MEMORY_LIMIT = "-" #in bytes, e.g. "256M"; every profile defaults to 256M
+TIME_LIMIT = "-" #in nano( 10^-9 ) seconds
+MAX_PIDS = "-"
+OUTPUT_LIMIT = "-" #in bytes; anything larger is Output Limit Exceeded
+WALL_TIME_LIMIT = "-" #in nano( 10^-9 ) seconds; bounds runs that sleep or block
+if os.path.exists("/sys/fs/cgroup/cgroup.controllers"):
+    # cgroup v2: the sandbox uses a single directory for all three
+    MEMORY_CGROUP = CPUACCT_CGROUP = PIDS_CGROUP = "/sys/fs/cgroup/test"
+else:
+    MEMORY_CGROUP = "/sys/fs/cgroup/memory/test"
+    CPUACCT_CGROUP = "/sys/fs/cgroup/cpuacct/test/"
+    PIDS_CGROUP = "/sys/fs/cgroup/pids/test/"
+# what every jail holds besides the executable, see jails.py; jails live
+# under JAILS_DIR, on a tmpfs once 'prepare_jails' ran
+JAIL_TEMPLATE_DIR = os.getcwd() + "/contest/sandbox/jail/"
+JAILS_DIR = os.getcwd() + "/contest/sandbox/jails/"
 EXECUTABLE_FILE = "executable"
 INPUT_FILE = ""
-OUTPUT_FILE = os.getcwd() + "/contest/sandbox/output"
-WHITELIST = os.getcwd() + "/contest/sandbox/wl" #wl for sys calls
+WHITELIST = os.getcwd() + "/contest/sandbox/wl" #wl for sys calls, when no profile is given
 UID = "1000"
 GID = "1000"
+
+# "server" sends jobs to a running 'sandbox-exe --server' over SANDBOX_SOCKET,
+# "native" runs them in the judge worker through the _sandbox extension (see
+# sandbox_native.py; the worker then needs the privileges of sandbox-exe),
+# "exe" runs 'sudo sandbox-exe' once per testcase
+SANDBOX_BACKEND = "server"
+SANDBOX_SOCKET = os.getcwd() + "/contest/sandbox/sandbox.sock"
+# Number of batches sent to the server at the same time; should match the
+# <slots> given to start_sandbox_server. Slots run concurrently, hence each
+# slot has its own jail and each submission its own output directory.
+SANDBOX_SLOTS = 1
+SLOT_JAIL_DIR = JAILS_DIR + "slot{}/"
+OUTPUTS_DIR = os.getcwd() + "/contest/sandbox/outputs/"
+# "native": every batch runs in a fresh jail under NATIVE_JAILS_DIR. Pool
+# slots are named by number, so keep NATIVE_CG_POOL_SIZE at 0 unless a
+# single judge worker runs on the host.
+NATIVE_JAILS_DIR = JAILS_DIR + "native/"
+NATIVE_CG_POOL_SIZE = 0
+
+# Submissions are compiled once with COMPILER and COMPILE_FLAGS; the binaries
+# are kept in COMPILE_CACHE_DIR keyed by the hash of (source, flags, compiler)
+COMPILER = "gcc"
+COMPILE_FLAGS = ["--static"]
+# Accepted languages by file extension: how they are compiled and the sandbox
+# profile (system calls and default limits, see sandbox/profiles.c) their
+# executables run under. Uploads of any other extension are taken as C.
+LANGUAGES = {
+    ".c": {"compiler": COMPILER, "flags": COMPILE_FLAGS, "profile": "c"},
+    ".cpp": {"compiler": "g++", "flags": ["--static","-O2"], "profile": "cpp"},
+}
+DEFAULT_LANGUAGE = ".c"
+COMPILE_CACHE_DIR = os.getcwd() + "/contest/compiled/"
+
+# "sandbox" compiles through a second 'sandbox-exe --server' (started by
+# start_compile_server) with the limits below, "local" runs COMPILER directly
+COMPILE_BACKEND = "sandbox"
+COMPILE_SOCKET = os.getcwd() + "/contest/sandbox/compile.sock"
+# chroot holding the toolchain, set up by prepare_compile_jail
+COMPILE_JAIL_DIR = os.getcwd() + "/contest/sandbox/compile_jail/"
+COMPILE_MEMORY_LIMIT = "512M"
+COMPILE_TIME_LIMIT = "10000000000" #in nano( 10^-9 ) seconds
+COMPILE_MAX_PIDS = "16" # gcc runs cc1, as, collect2 and ld
+COMPILE_OUTPUT_LIMIT = "67108864" # bytes, per file: diagnostics and the executable
+COMPILE_WALL_TIME = 30 #in seconds, enforced by the compile server
+# Compiles running at once (should match the slots of start_compile_server)
+# and how many more may wait for one before submitters are held back
+COMPILE_WORKERS = 2
+COMPILE_QUEUE_SIZE = 16
+
+# True: uploads are queued and judged by 'manage.py judge_worker' processes.
+# False: the upload request judges the submission itself, as it used to.
+JUDGE_ASYNC = True
+
+# Pages of the submissions and standings views, and seconds a standings page
+# is served from the cache (a score change drops it at once)
+SUBMISSIONS_PER_PAGE = 50
+STANDINGS_PER_PAGE = 50
+STANDINGS_CACHE_SECONDS = 30
+# seconds the problem list and statements are cached (see context_cache.py)
+PROBLEMS_CACHE_SECONDS = 300
+
+# Judge workers (or, with the cluster, submissions being judged) that may
+# work on rejudges at a time, see judge_queue.rejudge; uploads always go first
+REJUDGE_WORKERS = 2
+
+# Judging on several hosts (see cluster.py): 'manage.py judge_coordinator'
+# once, 'manage.py judge_node' on every judge host, all sharing the database
+CLUSTER_NODE_NAME = "" # as registered; the host name if empty
+# testcases as every node sees them (e.g. a network mount), copied from there
+# into CLUSTER_CACHE_DIR as nodes need them
+CLUSTER_TESTCASES_SOURCE = os.getcwd() + "/contest/testcases"
+CLUSTER_CACHE_DIR = os.getcwd() + "/contest/node_cache/"
+CLUSTER_HEARTBEAT = 5 # seconds between heartbeats of a busy node
+CLUSTER_NODE_TIMEOUT = 30 # seconds without a heartbeat before a node is dead
+CLUSTER_STEAL_AFTER = 10 # seconds a job waits for a node holding its testcases
+CLUSTER_MIN_JOB_CASES = 4 # testcases per job, at least
+CLUSTER_CLAIM_WINDOW = 50 # oldest pending jobs a node looks through per claim
+
+# Metrics (see metrics.py): the files each judge process keeps its counts in
+# ("" turns them off), the addresses the /contest/metrics/ view answers and
+# the file every run appends its trace record to ("" for none)
+METRICS_DIR = os.getcwd() + "/contest/metrics/"
+METRICS_ALLOWED_IPS = ["127.0.0.1"]
+TRACE_FILE = ""
+
+# Native output comparator (build with checker/run.sh). "exact" compares byte
+# for byte; "tolerant" ignores trailing whitespace on lines and trailing blank
+# lines
+CHECKER = os.getcwd() + "/contest/checker/checker"
+CHECKER_MODE = "exact"
+CHECKER_MIN_BYTES = 256 * 1024 # smaller expected outputs are compared in Python
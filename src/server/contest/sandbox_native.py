@@ -0,0 +1,60 @@
+import os
+import shutil
+import tempfile
+import threading
+from concurrent.futures import ThreadPoolExecutor
+from .sandbox_config import *
+from . import sandbox_client
+from . import metrics
+from . import jails
+
+_lock = threading.Lock()
+_sandbox = None
+
+def _module():
+    """ The _sandbox extension (built by 'make -C contest/sandbox python'),
+        initialised on first use """
+    global _sandbox
+    with _lock:
+        if _sandbox is None:
+            from . import _sandbox as module
+            module.init(MEMORY_CGROUP,CPUACCT_CGROUP,PIDS_CGROUP,int(UID),int(GID),NATIVE_CG_POOL_SIZE,1)
+            _sandbox = module
+    return _sandbox
+
+def run_batch(executable_path,input_files,output_dir,profile,limits=None,on_result=None):
+    """ Same as sandbox_client.run_batch, run in this process by the _sandbox
+        extension instead of by the sandbox server. Each batch gets a jail of
+        its own, so any number of batches and judge workers may run at once """
+    sandbox = _module()
+    limits = limits or sandbox_client.default_limits()
+    os.makedirs(NATIVE_JAILS_DIR,exist_ok=True)
+    jail_dir = tempfile.mkdtemp(dir=NATIVE_JAILS_DIR)
+    try:
+        jails.populate(jail_dir)
+        jails.install(jail_dir,executable_path)
+        output_files = [output_dir + '/' + os.path.basename(f) for f in input_files]
+        done = None if on_result is None else lambda i,result: on_result(i,result,output_files[i])
+        # the GIL is released while the cases run, and taken for each done()
+        with metrics.busy_slot():
+            results = sandbox.run_batch(EXECUTABLE_FILE,jail_dir,list(zip(input_files,output_files)),
+                                        *[str(limits[f]) for f in sandbox_client.LIMIT_FIELDS],profile=profile,on_result=done)
+    finally:
+        shutil.rmtree(jail_dir,ignore_errors=True)
+    return list(zip(results,output_files))
+
+def run_parallel(executable_path,input_files,output_dir,profile,limits=None,on_result=None):
+    """ Same as sandbox_client.run_parallel: up to SANDBOX_SLOTS batches on
+        threads of this process """
+    n = min(SANDBOX_SLOTS,len(input_files))
+    if n <= 1:
+        return run_batch(executable_path,input_files,output_dir,profile,limits,on_result)
+
+    chunks = [input_files[i::n] for i in range(n)]
+    with ThreadPoolExecutor(max_workers=n) as pool:
+        results = list(pool.map(lambda c: run_batch(executable_path,chunks[c],output_dir,profile,limits,sandbox_client.chunk_callback(on_result,c,n)),range(n)))
+
+    ordered = [None] * len(input_files)
+    for i, chunk_results in enumerate(results):
+        ordered[i::n] = chunk_results
+    return ordered
@@ -0,0 +1,71 @@
+from django.core.cache import cache
+from django.db import transaction
+from django.db.models import Max,Sum
+from django.utils import timezone
+from .sandbox_config import *
+from .models import Submission, Standing, UserScore, Problem as contest_problem
+
+# The standings of the contest, kept as submissions are scored instead of
+# being worked out from all submissions on every page view. 'record' updates
+# the Standing of the user and problem of a scored submission and the
+# UserScore (total) of the user, reading only that user's submissions of
+# that problem. UserScore rows in their default order are the ranking; pages
+# of it are cached until a UserScore changes.
+
+def record(submission):
+    """ Brings the standings of the user and problem of submission up to date
+        with its score. Works from the user's submissions rather than from the
+        old best, so lowered scores (rejudges) are taken in too """
+    with transaction.atomic():
+        # Serializes the records of one user: under REPEATABLE READ a record
+        # of another of the user's problems, running meanwhile, would
+        # otherwise be missing from the sum below and the later of the two
+        # would save a stale total. The locking read comes before any other,
+        # so the snapshot the sum reads is taken once the other committed.
+        UserScore.objects.select_for_update().get_or_create(user_id=submission.user_id)
+        submissions = Submission.objects.filter(user_id=submission.user_id,problem_id=submission.problem_id)
+        best = submissions.order_by('-score','time').values('score','time').first()
+        Standing.objects.update_or_create(
+            user_id=submission.user_id,problem_id=submission.problem_id,
+            defaults={'best_score': best['score'],
+                      'best_time': best['time'] if best['score'] > 0 else None,
+                      'submissions': submissions.count()})
+        totals = Standing.objects.filter(user_id=submission.user_id).aggregate(total=Sum('best_score'),reached=Max('best_time'))
+        UserScore.objects.filter(user_id=submission.user_id).update(
+            total=totals['total'] or 0,reached=totals['reached'],updated=timezone.now())
+
+def rebuild():
+    """ Recomputes all standings from the submissions, e.g. after submissions
+        were deleted by hand. Returns how many user and problem pairs """
+    pairs = set(Submission.objects.values_list('user_id','problem_id').distinct())
+    for standing in Standing.objects.all():
+        if (standing.user_id,standing.problem_id) not in pairs:
+            standing.delete()
+    UserScore.objects.exclude(user_id__in={user_id for user_id,problem_id in pairs}).delete()
+    for user_id,problem_id in pairs:
+        record(Submission(user_id=user_id,problem_id=problem_id))
+    return len(pairs)
+
+def page(number):
+    """ Page number (from 1) of the ranking as (rows, pages, problems): rows
+        are (rank, username, total, [best score per problem, None if not
+        tried]) and problems (problem_id, title) of the contest problems.
+        Served from the cache while no UserScore changed """
+    version = UserScore.objects.aggregate(v=Max('updated'))['v']
+    key = 'standings:{}:{}'.format(version.timestamp() if version else 0,number)
+    cached = cache.get(key)
+    if cached is not None:
+        return cached
+    users = UserScore.objects.count()
+    pages = max(1,-(-users // STANDINGS_PER_PAGE))
+    first = (number - 1) * STANDINGS_PER_PAGE
+    ranked = list(UserScore.objects.select_related('user')[first:first + STANDINGS_PER_PAGE])
+    problems = list(contest_problem.objects.values_list('problem_id','problem__title'))
+    best = {}
+    for s in Standing.objects.filter(user_id__in=[r.user_id for r in ranked]).values('user_id','problem_id','best_score'):
+        best[(s['user_id'],s['problem_id'])] = s['best_score']
+    rows = [(first + i + 1,r.user.username,r.total,[best.get((r.user_id,p)) for p,title in problems])
+            for i,r in enumerate(ranked)]
+    result = (rows,pages,problems)
+    cache.set(key,result,STANDINGS_CACHE_SECONDS)
+    return result
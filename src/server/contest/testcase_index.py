@@ -0,0 +1,94 @@
+import os
+import json
+import hashlib
+import fnmatch
+from django.db.models import F
+
+# Every testcase directory holds a MANIFEST_FILE describing its testcases, so
+# that judging a submission does not list the directory or stat its files:
+#   {"cases": [{"input": "input1", "output": "output1",
+#               "input_size": .., "output_size": .., (bytes)
+#               "input_sha256": .., "output_sha256": ..,
+#               "weight": 1, "limits": {}}, ...]}
+# in the order the testcases run (sorted by input file). "weight" is the
+# share of the testcase in a partial score and "limits" its own sandbox
+# limits (keys of sandbox_client.LIMIT_FIELDS, see Runner.case_limits); both
+# may be edited by hand and are kept by 'build'.
+#
+# 'build' runs whenever a contest Problem or its problem is saved (see
+# models.py), or through 'manage.py index_testcases' after testcases were
+# copied in by hand. It also bumps contest.Problem.testcases_version, which
+# judge workers compare against the manifest they keep in memory.
+
+MANIFEST_FILE = 'manifest.json'
+BLOCK_SIZE = 64 * 1024
+# problem id -> (testcases_version, cases) of the manifests loaded so far
+_manifests = {}
+
+def sha256_of(path):
+    digest = hashlib.sha256()
+    with open(path,'rb') as f:
+        for block in iter(lambda: f.read(BLOCK_SIZE),b''):
+            digest.update(block)
+    return digest.hexdigest()
+
+def expected_output(input_file):
+    """ Name of the expected output of the testcase input_file """
+    return 'output' + input_file.split('input',1)[1]
+
+def build(testcase_dir):
+    """ Writes the manifest of testcase_dir, keeping the weights and limits of
+        testcases already in it. Returns the manifest """
+    path = testcase_dir + '/' + MANIFEST_FILE
+    try:
+        with open(path) as f:
+            old = {case['input']: case for case in json.load(f)['cases']}
+    except (OSError,ValueError,KeyError):
+        old = {}
+    cases = []
+    for name in sorted(fnmatch.filter(os.listdir(testcase_dir),'input*')):
+        output = expected_output(name)
+        kept = old.get(name,{})
+        cases.append({
+            "input": name,
+            "output": output,
+            "input_size": os.path.getsize(testcase_dir + '/' + name),
+            "output_size": os.path.getsize(testcase_dir + '/' + output),
+            "input_sha256": sha256_of(testcase_dir + '/' + name),
+            "output_sha256": sha256_of(testcase_dir + '/' + output),
+            "weight": kept.get("weight",1),
+            "limits": kept.get("limits",{}),
+        })
+    manifest = {"cases": cases}
+    # replaced at once: workers may read it at any time
+    with open(path + '.tmp','w') as f:
+        json.dump(manifest,f,indent=1)
+    os.replace(path + '.tmp',path)
+    return manifest
+
+def reindex(problem):
+    """ Rebuilds the manifest of the contest Problem problem, if its testcases
+        are in place, and makes workers drop the one they hold """
+    # imported here: both import this module
+    from .models import Problem
+    from .runner import Runner
+    testcase_dir = Runner.BASE_TEST_CASES_DIR + '/' + str(problem.problem_id)
+    if os.path.isdir(testcase_dir):
+        build(testcase_dir)
+    Problem.objects.filter(id=problem.id).update(testcases_version=F('testcases_version') + 1)
+
+def cases(problem,testcase_dir):
+    """ The testcases of the contest Problem problem, as listed by the
+        manifest in testcase_dir. Reads the manifest only if this process has
+        not since problem.testcases_version, and builds it if there is none """
+    cached = _manifests.get(problem.problem_id)
+    if cached is not None and cached[0] == problem.testcases_version:
+        return cached[1]
+    try:
+        with open(testcase_dir + '/' + MANIFEST_FILE) as f:
+            manifest = json.load(f)
+    except (OSError,ValueError):
+        # testcases from before manifests existed
+        manifest = build(testcase_dir)
+    _manifests[problem.problem_id] = (problem.testcases_version,manifest['cases'])
+    return manifest['cases']
@@ -1,3 +1,66 @@
-from django.test import TestCase
+import os
+import shutil
+import tempfile
+import unittest
+from django.test import SimpleTestCase
+from . import output_checker
+from .output_checker import CHK_SAME,CHK_DIFFERENT
 
-# Create your tests here.
+# (name, expected output, actual output, exact result, tolerant result)
+CHECKER_CASES = [
+    ("identical",b"1 2\n3\n",b"1 2\n3\n",(CHK_SAME,-1),(CHK_SAME,-1)),
+    ("trailing blanks",b"1 2\n3\n",b"1 2  \n3\t\n",(CHK_DIFFERENT,3),(CHK_SAME,-1)),
+    ("crlf",b"1 2\n3\n",b"1 2\r\n3\r\n",(CHK_DIFFERENT,3),(CHK_SAME,-1)),
+    ("no final newline in actual",b"1 2\n3\n",b"1 2\n3",(CHK_DIFFERENT,5),(CHK_SAME,-1)),
+    ("no final newline in expected",b"1 2\n3",b"1 2\n3\n",(CHK_DIFFERENT,5),(CHK_SAME,-1)),
+    ("extra blank lines in actual",b"1 2\n3\n",b"1 2\n3\n\n \n",(CHK_DIFFERENT,6),(CHK_SAME,-1)),
+    ("extra blank lines in expected",b"1 2\n3\n\n\t\n",b"1 2\n3\n",(CHK_DIFFERENT,6),(CHK_SAME,-1)),
+    ("form feed is not blank",b"1\n",b"1\n\x0c\n",(CHK_DIFFERENT,2),(CHK_DIFFERENT,2)),
+    ("mid-line difference",b"1 2\n3\n",b"1 3\n3\n",(CHK_DIFFERENT,2),(CHK_DIFFERENT,2)),
+    ("extra line",b"1 2\n3\n",b"1 2\n3\n4\n",(CHK_DIFFERENT,6),(CHK_DIFFERENT,6)),
+    ("short actual",b"1 2\n3\n",b"1 2\n",(CHK_DIFFERENT,4),(CHK_DIFFERENT,4)),
+    ("empty",b"",b"",(CHK_SAME,-1),(CHK_SAME,-1)),
+    ("empty actual",b"1\n",b"",(CHK_DIFFERENT,0),(CHK_DIFFERENT,0)),
+]
+
+class OutputCheckerTests(SimpleTestCase):
+    """ The Python comparators and checker/checker must give the same
+        (verdict, offset): which one runs depends only on the output size """
+
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def files(self,expected,actual):
+        paths = []
+        for name,data in (("expected",expected),("actual",actual)):
+            path = os.path.join(self.dir,name)
+            with open(path,'wb') as f:
+                f.write(data)
+            paths.append(path)
+        return paths
+
+    def test_python(self):
+        for name,expected,actual,exact,tolerant in CHECKER_CASES:
+            with self.subTest(name):
+                e,a = self.files(expected,actual)
+                self.assertEqual(output_checker.compare_exact(e,a),exact)
+                self.assertEqual(output_checker.compare_tolerant(e,a),tolerant)
+
+    def test_large_python(self):
+        line = b"x" * 1000 + b"\n"
+        expected = line * 200
+        e,a = self.files(expected,expected[:-2] + b"y\n")
+        self.assertEqual(output_checker.compare_exact(e,a),(CHK_DIFFERENT,len(expected) - 2))
+        e,a = self.files(expected,expected + b" \r\n\n")
+        self.assertEqual(output_checker.compare_tolerant(e,a),(CHK_SAME,-1))
+
+    @unittest.skipUnless(os.access(output_checker.CHECKER,os.X_OK),"checker not built (checker/run.sh)")
+    def test_native_agrees(self):
+        for name,expected,actual,exact,tolerant in CHECKER_CASES:
+            with self.subTest(name):
+                e,a = self.files(expected,actual)
+                self.assertEqual(output_checker.compare_native(e,a,"exact"),exact)
+                self.assertEqual(output_checker.compare_native(e,a,"tolerant"),tolerant)
@@ -6,7 +6,10 @@ urlpatterns = [
     url(r'^auth/', views.auth, name='auth'),
     url(r'^problem/(?P<problem_id>[0-9]+)/$', views.problem, name='problem'),
     url(r'^upload/', views.upload, name='upload'),
+    url(r'^submission/(?P<submission_id>[0-9]+)/status/$', views.submission_status, name='submission_status'),
     url(r'^logout',views.logout_view, name='logout'),
+    url(r'^metrics/$',views.metrics, name='metrics'),
     url(r'^submissions',views.display_submissions, name='submissions'),
+    url(r'^standings/$',views.standings, name='standings'),
     url(r'^submissions/(?P<p>[0-9]+)/$',views.display_submissions, name='problem_submissions')
 ]
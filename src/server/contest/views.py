@@ -1,14 +1,20 @@
-from django.http import HttpResponse
+from django.http import HttpResponse,JsonResponse
 from django.shortcuts import render
 from .forms import LoginForm,SubmissionForm
-from .models import Problem as contest_problem,Submission
+from .models import Problem as contest_problem,Submission,JudgeJob
 from django.contrib.auth.models import User
 from django.contrib.auth import authenticate,login,logout
 from trial.models import Problem as all_problems
 from time import sleep
 import os
 from datetime import datetime
-from . import runner
+from . import judge_queue
+from . import context_cache
+from . import standings as contest_standings
+from . import metrics as judge_metrics
+from .cluster import live_nodes
+from django.db.models import Count,Sum
+from .sandbox_config import JUDGE_ASYNC,LANGUAGES,DEFAULT_LANGUAGE,METRICS_ALLOWED_IPS,SANDBOX_SLOTS,SUBMISSIONS_PER_PAGE
 from ipware.ip import get_ip
 from django.utils import timezone
 from django.contrib import messages
@@ -42,6 +48,7 @@ def auth(request):
         if user is not None and user.is_active:
             # login_ successful
             login(request,user)
+            request.session[context_cache.SESSION_USERNAME] = user.username
             # user_id = request.session['_auth_user_id']
             # username = User.objects.get(id = user_id).username
             request.session.set_expiry(0) #session expires when browser is closed
@@ -58,13 +65,12 @@ def auth(request):
 def problem(request,problem_id,submission=None):
     """ Renders the page that lists all problems of the contest"""
     if request.user.is_authenticated:
-        problem = all_problems.objects.get(problem_id=problem_id)
-        user = User.objects.get(id=request.session['_auth_user_id'])
+        problem = context_cache.problem(problem_id)
         submission_form = SubmissionForm()
         context = {
             "submission_form" : submission_form,
             "problem" : problem,
-            "username" : user.username,
+            "username" : context_cache.username(request),
             "submission" : submission
         }
         return render(request,'problem.html',context)
@@ -73,20 +79,11 @@ def problem(request,problem_id,submission=None):
 
 def problemList(request):
     """ Renders the page for particular problem """
-    titles = []
-    ids = []
-    contest_id = []
-    problems = contest_problem.objects.all()
-    user = User.objects.get(id=request.session['_auth_user_id'])
-
-    for problem in problems:
-        titles.append(problem.problem.title)
-        ids.append(problem.problem_id)
-        contest_id.append(problem.id)
-
+    if not request.user.is_authenticated:
+        return HttpResponse("Session Expired. Login again")
     context = {
-        'data':list(zip(contest_id,ids,titles)),
-        'username':user.username
+        'data':context_cache.problem_list(),
+        'username':context_cache.username(request)
     }
 
     return render(request,'problem_page.html',context)
@@ -94,18 +91,22 @@ def problemList(request):
 
 def upload(request):
     """
-    Receives C file.
+    Receives a source file in one of the LANGUAGES.
     Passes Submission object to runner class for compilation, execution and evaluation.
      """
+    if not request.user.is_authenticated:
+        return HttpResponse("Session Expired. Login again")
     if request.method == "POST":
 
         ip_address = get_ip(request)
         problem_id = request.POST.get('problem_id')
         problem_ = contest_problem.objects.get(problem_id=problem_id)
-        user = User.objects.get(id=request.session['_auth_user_id'])
-        submission_file_name = user.username + '_' + str(problem_.problem_id) + '.c'
-
+        user = request.user
         uploaded_filedata = request.FILES['submission_file']
+        extension = os.path.splitext(uploaded_filedata.name)[1]
+        if extension not in LANGUAGES:
+            extension = DEFAULT_LANGUAGE
+        submission_file_name = user.username + '_' + str(problem_.problem_id) + extension
         #creates /contest/submissions folder if does not exist
         if not os.path.isdir("contest/submissions"):
             os.makedirs("contest/submissions")
@@ -126,29 +127,97 @@ def upload(request):
                         local_file=uploaded_filedata
                         )
 
-        evaluate = runner.Runner(submission)
-        evaluate.check_all()
-        evaluate.score_obtained()
+        judge_queue.enqueue(submission,filepath)
+        if not JUDGE_ASYNC:
+            judge_queue.judge(submission)
 
-        return problem(request,problem_.problem_id,evaluate)
+        return problem(request,problem_.problem_id,submission)
     else:
         return HttpResponse("/contest/upload/")
 
+def submission_status(request,submission_id):
+    """ Judging state of one of the user's submissions, polled by the problem page """
+    if not request.user.is_authenticated:
+        return JsonResponse({"error":"Session Expired. Login again"},status=403)
+    try:
+        submission = Submission.objects.get(id=submission_id,user=request.user)
+    except Submission.DoesNotExist:
+        return JsonResponse({"error":"No such submission"},status=404)
+    return JsonResponse({
+        "status" : submission.status,
+        "tests" : submission.tests,
+        "results" : submission.run_results,
+        "score" : str(submission.score)
+    })
+
 def logout_view(request):
     logout(request)
     messages.info(request,"You have been logged out")
     return index(request)
 
 def display_submissions(request):
-    """ Renders submissions page to display submissions made till the given time """
-    user = User.objects.get(id=request.session['_auth_user_id'])
-
-    if request.GET.keys():
-        query = Submission.objects.filter(problem_id=request.GET['p'])
-    else:
-        query = Submission.objects.all().order_by('-time')
+    """ Renders submissions page to display submissions made till the given time,
+        SUBMISSIONS_PER_PAGE at a time, newest first. ?before=<id> gives the
+        page of the submissions older than id, which reads only that page
+        however many submissions there are """
+    if not request.user.is_authenticated:
+        return HttpResponse("Session Expired. Login again")
+    username = context_cache.username(request)
+
+    query = Submission.objects.select_related('user','problem').order_by('-id')
+    problem_id = request.GET.get('p')
+    if problem_id:
+        query = query.filter(problem_id=problem_id)
+    try:
+        before = int(request.GET.get('before',''))
+    except ValueError:
+        # none, or not a submission id: the newest page
+        before = None
+    if before is not None:
+        query = query.filter(id__lt=before)
+    # one more than shown, to know whether there is a next page
+    submissions = list(query[:SUBMISSIONS_PER_PAGE + 1])
+    older = submissions[SUBMISSIONS_PER_PAGE - 1].id if len(submissions) > SUBMISSIONS_PER_PAGE else None
     context = {
-            "submissions" : query,
-            "username" : user.username
+            "submissions" : submissions[:SUBMISSIONS_PER_PAGE],
+            "username" : username,
+            "problem_id" : problem_id,
+            "older" : older
     }
     return render(request,"display_submissions.html",context)
+
+def standings(request):
+    """ Renders the ranking of the contest, a page (?page=<n>) at a time, see standings.py """
+    if not request.user.is_authenticated:
+        return HttpResponse("Session Expired. Login again")
+    username = context_cache.username(request)
+    try:
+        number = max(1,int(request.GET.get('page',1)))
+    except ValueError:
+        number = 1
+    rows,pages,problems = contest_standings.page(number)
+    context = {
+            "rows" : rows,
+            "problems" : problems,
+            "page" : number,
+            "previous" : number - 1 if number > 1 else None,
+            "next" : number + 1 if number < pages else None,
+            "pages" : pages,
+            "username" : username
+    }
+    return render(request,"standings.html",context)
+
+def metrics(request):
+    """ Judge metrics in the Prometheus text format, see metrics.py """
+    if get_ip(request) not in METRICS_ALLOWED_IPS:
+        return HttpResponse(status=403)
+    submissions = Submission.objects.values('status').annotate(n=Count('id'))
+    jobs = JudgeJob.objects.values('status').annotate(n=Count('id'))
+    free = live_nodes().aggregate(free=Sum('free_slots'))['free'] or 0
+    gauges = {
+        "crux_submissions" : {(("status",row['status']),): row['n'] for row in submissions},
+        "crux_cluster_jobs" : {(("status",row['status']),): row['n'] for row in jobs},
+        "crux_cluster_free_slots" : {(): free},
+        "crux_sandbox_slots" : {(): SANDBOX_SLOTS},
+    }
+    return HttpResponse(judge_metrics.render(gauges),content_type="text/plain; version=0.0.4")
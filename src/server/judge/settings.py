@@ -52,6 +52,10 @@ MIDDLEWARE_CLASSES = (
     'django.middleware.security.SecurityMiddleware',
 )
 
+# sessions are read from the cache, and from the database only on a miss,
+# so that page loads at the start of a contest do not all query it
+SESSION_ENGINE = 'django.contrib.sessions.backends.cached_db'
+
 ROOT_URLCONF = 'judge.urls'
 
 TEMPLATES = [